@@ -18,11 +18,24 @@ namespace plog
         {
             return util::toNarrow(str, codePage::kUTF8);
         }
+
+        // Converts length characters into scratch, which holds at least 3 bytes per
+        // character, without allocating. Returns the UTF-8 text and its length.
+        static const char* convert(const util::nchar* str, size_t& length, char* scratch, size_t scratchSize)
+        {
+            length = WideCharToMultiByte(codePage::kUTF8, 0, str, static_cast<int>(length), scratch, static_cast<int>(scratchSize), 0, 0);
+            return scratch;
+        }
 #else
         static const std::string& convert(const util::nstring& str)
         {
             return str;
         }
+
+        static const char* convert(const util::nchar* str, size_t&, char*, size_t)
+        {
+            return str;
+        }
 #endif
     };
 }
@@ -1,6 +1,21 @@
 #pragma once
 #include <plog/Severity.h>
 #include <plog/Util.h>
+#include <cstdio>
+#include <cstring>
+
+// 1: numbers streamed into a record are kept as typed arguments next to a template
+// of the literal text, and the message is rendered only when asked for. Must be
+// set alike in every translation unit.
+#ifndef PLOG_CAPTURE_ARGS
+#   define PLOG_CAPTURE_ARGS 0
+#endif
+
+// Longest message a record holds, the rest is cut off. It is kept inline, so
+// building a record on the logging thread does not allocate.
+#ifndef PLOG_MAX_MESSAGE_LENGTH
+#   define PLOG_MAX_MESSAGE_LENGTH 256
+#endif
 
 #ifdef __cplusplus_cli
 #include <vcclr.h>  // For PtrToStringChars
@@ -50,11 +65,127 @@ namespace plog
 #endif
     }
 
+    //////////////////////////////////////////////////////////////////////////
+    // Typed arguments of a record, see PLOG_CAPTURE_ARGS
+
+    namespace arg
+    {
+        const char kMarker = '\x1f';    // stands for the next argument in a template
+
+        // each argument is its type followed by 8 bytes of its value in host order
+        enum Type
+        {
+            kInt = 1,       // long long
+            kUnsigned = 2,  // unsigned long long
+            kDouble = 3     // double
+        };
+
+        const size_t kSize = 9;
+        const size_t kMaxArgs = 16;     // further numbers go into the template as text
+
+        typedef util::FixedString<char, PLOG_MAX_MESSAGE_LENGTH> Template;
+        typedef util::FixedString<char, kMaxArgs * kSize> Args;
+
+        inline void put(Args& args, Type type, const void* value)
+        {
+            args.push_back(char(type));
+            args.append(static_cast<const char*>(value), 8);
+        }
+
+        // Renders a template and its arguments as streaming them would have
+        inline void render(const Template& tmpl, const Args& args, util::nstring& out)
+        {
+            out.clear();
+            size_t next = 0;
+            size_t literal = 0;
+            for (size_t i = 0; i <= tmpl.size(); ++i)
+            {
+                if (i < tmpl.size() && tmpl[i] != kMarker)
+                    continue;
+
+#ifdef _WIN32
+                out += util::toWide(std::string(tmpl.data() + literal, i - literal).c_str());
+#else
+                out.append(tmpl.data() + literal, i - literal);
+#endif
+                literal = i + 1;
+                if (i == tmpl.size() || next + kSize > args.size())
+                    continue;
+
+                char text[32];
+                const char* value = args.data() + next + 1;
+                switch (args[next])
+                {
+                case kInt:
+                {
+                    long long v;
+                    std::memcpy(&v, value, 8);
+                    std::snprintf(text, sizeof(text), "%lld", v);
+                    break;
+                }
+                case kUnsigned:
+                {
+                    unsigned long long v;
+                    std::memcpy(&v, value, 8);
+                    std::snprintf(text, sizeof(text), "%llu", v);
+                    break;
+                }
+                default:
+                {
+                    double v;
+                    std::memcpy(&v, value, 8);
+                    std::snprintf(text, sizeof(text), "%g", v);
+                    break;
+                }
+                }
+                for (const char* c = text; *c; ++c)
+                    out += util::nchar(*c);
+                next += kSize;
+            }
+        }
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // Position of the audio block processed by the calling thread
+
+    struct BlockPosition
+    {
+        bool    valid;
+        double  samplePos;
+        double  ppqPos;
+    };
+
+    namespace detail
+    {
+        inline BlockPosition& currentBlockPosition()
+        {
+            static thread_local BlockPosition position = { false, 0, 0 };
+            return position;
+        }
+    }
+
+    inline void setBlockPosition(double samplePos, double ppqPos)
+    {
+        BlockPosition& position = detail::currentBlockPosition();
+        position.samplePos = samplePos;
+        position.ppqPos = ppqPos;
+        position.valid = true;
+    }
+
+    inline void clearBlockPosition()
+    {
+        detail::currentBlockPosition().valid = false;
+    }
+
+    // Message text of a record, see PLOG_MAX_MESSAGE_LENGTH
+    typedef util::FixedString<util::nchar, PLOG_MAX_MESSAGE_LENGTH> MessageBuffer;
+
     class Record
     {
     public:
         Record(Severity severity, const char* func, size_t line, const char* file, const void* object)
-            : m_severity(severity), m_tid(util::gettid()), m_object(object), m_line(line), m_func(func), m_file(file)
+            : m_monotonicNanos(util::monotonicNanos()), m_blockPosition(detail::currentBlockPosition())
+            , m_severity(severity), m_tid(util::gettid()), m_object(object), m_line(line), m_func(func), m_file(file)
         {
             util::ftime(&m_time);
         }
@@ -82,7 +213,7 @@ namespace plog
         Record& operator<<(std::ostream& (*data)(std::ostream&))
 #endif
         {
-            m_message << data;
+            put(data);
             return *this;
         }
 
@@ -108,9 +239,7 @@ namespace plog
         template<typename T>
         Record& operator<<(const T& data)
         {
-            using namespace plog::detail;
-
-            m_message << data;
+            put(data);
             return *this;
         }
 
@@ -122,6 +251,16 @@ namespace plog
             return m_time;
         }
 
+        virtual unsigned long long getMonotonicNanos() const
+        {
+            return m_monotonicNanos;
+        }
+
+        virtual const BlockPosition& getBlockPosition() const
+        {
+            return m_blockPosition;
+        }
+
         virtual Severity getSeverity() const
         {
             return m_severity;
@@ -144,31 +283,185 @@ namespace plog
 
         virtual const util::nchar* getMessage() const
         {
-            m_messageStr = m_message.str();
+#if PLOG_CAPTURE_ARGS
+            arg::render(m_template, m_args, m_messageStr);
             return m_messageStr.c_str();
+#else
+            return m_message.c_str();
+#endif
+        }
+
+#if PLOG_CAPTURE_ARGS
+        // literal text of the message, arg::kMarker where an argument goes
+        const arg::Template& getTemplate() const
+        {
+            return m_template;
         }
 
+        const arg::Args& getArgs() const
+        {
+            return m_args;
+        }
+#endif
+
         virtual const char* getFunc() const
         {
             m_funcStr = util::processFuncName(m_func);
             return m_funcStr.c_str();
         }
 
+        // function as given to the constructor, getFunc shortens it and allocates
+        virtual const char* getRawFunc() const
+        {
+            return m_func;
+        }
+
         virtual const char* getFile() const
         {
             return m_file;
         }
 
+    private:
+        // Strings and numbers are formatted into the inline message without
+        // allocating, other types go through a string stream.
+        void put(const char* data)
+        {
+            data = data ? data : "(null)";
+#if PLOG_CAPTURE_ARGS
+            for (; *data; ++data)
+                m_template.push_back(*data == arg::kMarker ? '?' : *data);
+#else
+            putText(data, std::strlen(data));
+#endif
+        }
+
+        void put(const std::string& data) { put(data.c_str()); }
+
+#if !PLOG_CAPTURE_ARGS && defined(_WIN32)
+        void put(const wchar_t* data)
+        {
+            data = data ? data : L"(null)";
+            m_message.append(data, std::wcslen(data));
+        }
+
+        void put(const std::wstring& data) { m_message.append(data.data(), data.size()); }
+#endif
+
+        void put(signed char data) { put(static_cast<char>(data)); }
+        void put(unsigned char data) { put(static_cast<char>(data)); }
+        void put(char data) { const char str[] = { data, 0 }; put(str); }
+        void put(short data) { putInt(data); }
+        void put(int data) { putInt(data); }
+        void put(long data) { putInt(data); }
+        void put(long long data) { putInt(data); }
+        void put(unsigned short data) { putUnsigned(data); }
+        void put(unsigned int data) { putUnsigned(data); }
+        void put(unsigned long data) { putUnsigned(data); }
+        void put(unsigned long long data) { putUnsigned(data); }
+        void put(bool data) { putUnsigned(data); }
+        void put(float data) { putDouble(data); }
+        void put(double data) { putDouble(data); }
+
+        template<typename T>
+        void put(const T& data)
+        {
+            using namespace plog::detail;
+
+            util::nstringstream ss;
+            ss << data;
+#if PLOG_CAPTURE_ARGS && defined(_WIN32)
+            put(util::toNarrow(ss.str(), codePage::kActive));
+#elif PLOG_CAPTURE_ARGS
+            put(ss.str());
+#else
+            util::nstring text = ss.str();
+            m_message.append(text.data(), text.size());
+#endif
+        }
+
+        void putInt(long long data)
+        {
+#if PLOG_CAPTURE_ARGS
+            if (m_args.room() >= arg::kSize)
+            {
+                m_template.push_back(arg::kMarker);
+                arg::put(m_args, arg::kInt, &data);
+                return;
+            }
+#endif
+            char text[32];
+            putText(text, std::snprintf(text, sizeof(text), "%lld", data));
+        }
+
+        void putUnsigned(unsigned long long data)
+        {
+#if PLOG_CAPTURE_ARGS
+            if (m_args.room() >= arg::kSize)
+            {
+                m_template.push_back(arg::kMarker);
+                arg::put(m_args, arg::kUnsigned, &data);
+                return;
+            }
+#endif
+            char text[32];
+            putText(text, std::snprintf(text, sizeof(text), "%llu", data));
+        }
+
+        void putDouble(double data)
+        {
+#if PLOG_CAPTURE_ARGS
+            if (m_args.room() >= arg::kSize)
+            {
+                m_template.push_back(arg::kMarker);
+                arg::put(m_args, arg::kDouble, &data);
+                return;
+            }
+#endif
+            char text[32];
+            putText(text, std::snprintf(text, sizeof(text), "%g", data));
+        }
+
+        // narrow text as the message or template takes it, numbers once the arguments are full
+        void putText(const char* text, size_t length)
+        {
+#if PLOG_CAPTURE_ARGS
+            m_template.append(text, length);
+#elif defined(_WIN32)
+            int room = static_cast<int>(m_message.room());
+            wchar_t wide[PLOG_MAX_MESSAGE_LENGTH];
+            int wlen = room > 0 && length > 0 ? MultiByteToWideChar(codePage::kActive, 0, text, static_cast<int>(length), wide, room) : 0;
+            if (wlen == 0)
+            {
+                // cut off, the part that fits is widened byte by byte
+                for (; wlen < room && static_cast<size_t>(wlen) < length; ++wlen)
+                    wide[wlen] = static_cast<unsigned char>(text[wlen]);
+            }
+            m_message.append(wide, wlen);
+#else
+            m_message.append(text, length);
+#endif
+        }
+
     private:
         util::Time              m_time;
+        const unsigned long long m_monotonicNanos;
+        const BlockPosition     m_blockPosition;
         const Severity          m_severity;
         const unsigned int      m_tid;
         const void* const       m_object;
         const size_t            m_line;
-        util::nstringstream     m_message;
         const char* const       m_func;
         const char* const       m_file;
         mutable std::string     m_funcStr;
+
+    protected:
+        // the message is kept inline, a RecordSnapshot copies it into a queue slot
+#if PLOG_CAPTURE_ARGS
+        arg::Template           m_template;
+        arg::Args               m_args;
         mutable util::nstring   m_messageStr;
+#else
+        MessageBuffer           m_message;
+#endif
     };
 }
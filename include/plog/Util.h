@@ -17,6 +17,7 @@
 #ifdef _WIN32
 #   include <plog/WinApi.h>
 #   include <time.h>
+#   include <chrono>
 #   include <sys/timeb.h>
 #   include <io.h>
 #   include <share.h>
@@ -24,6 +25,7 @@
 #   include <unistd.h>
 #   include <sys/syscall.h>
 #   include <sys/time.h>
+#   include <time.h>
 #   include <pthread.h>
 #   if PLOG_ENABLE_WCHAR_INPUT
 #       include <iconv.h>
@@ -88,6 +90,19 @@ namespace plog
         }
 #endif
 
+        // Monotonic clock in nanoseconds, unaffected by wall clock adjustments
+        inline unsigned long long monotonicNanos()
+        {
+#ifdef _WIN32
+            // steady_clock is QueryPerformanceCounter on MSVC
+            return static_cast<unsigned long long>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#else
+            timespec ts;
+            ::clock_gettime(CLOCK_MONOTONIC, &ts);
+            return static_cast<unsigned long long>(ts.tv_sec) * 1000000000ULL + static_cast<unsigned long long>(ts.tv_nsec);
+#endif
+        }
+
         inline unsigned int gettid()
         {
 #ifdef _WIN32
@@ -205,6 +220,57 @@ namespace plog
             }
         }
 
+        // Text of a fixed capacity kept inline, so filling it never allocates.
+        // What does not fit is cut off.
+        template<typename Char, size_t Capacity>
+        class FixedString
+        {
+        public:
+            FixedString() : m_size(0)
+            {
+                m_data[0] = 0;
+            }
+
+            const Char* c_str() const { return m_data; }
+            const Char* data() const { return m_data; }
+            size_t size() const { return m_size; }
+            size_t room() const { return Capacity - m_size; }
+            Char operator[](size_t i) const { return m_data[i]; }
+
+            void clear()
+            {
+                m_size = 0;
+                m_data[0] = 0;
+            }
+
+            void append(const Char* data, size_t size)
+            {
+                size = size < room() ? size : room();
+                std::memcpy(m_data + m_size, data, size * sizeof(Char));
+                m_size += size;
+                m_data[m_size] = 0;
+            }
+
+            void assign(const FixedString& other)
+            {
+                m_size = other.m_size;
+                std::memcpy(m_data, other.m_data, (m_size + 1) * sizeof(Char));
+            }
+
+            void push_back(Char c)
+            {
+                if (m_size < Capacity)
+                {
+                    m_data[m_size++] = c;
+                    m_data[m_size] = 0;
+                }
+            }
+
+        private:
+            Char m_data[Capacity + 1];
+            size_t m_size;
+        };
+
         class NonCopyable
         {
         protected:
@@ -239,7 +305,17 @@ namespace plog
 #if defined(_WIN32) && (defined(__BORLANDC__) || defined(__MINGW32__))
                 m_file = ::_wsopen(fileName, _O_CREAT | _O_WRONLY | _O_BINARY, SH_DENYWR, _S_IREAD | _S_IWRITE);
 #elif defined(_WIN32)
-                ::_wsopen_s(&m_file, fileName, _O_CREAT | _O_WRONLY | _O_BINARY, _SH_DENYWR, _S_IREAD | _S_IWRITE);
+                // share delete access lets a rolling appender rename the file while it is open
+                HANDLE handle = CreateFileW(fileName, fileAccess::kGenericWrite, fileShare::kRead | fileShare::kDelete, NULL, fileCreation::kOpenAlways, fileAttribute::kNormal, NULL);
+                m_file = -1;
+                if (handle != reinterpret_cast<HANDLE>(-1))
+                {
+                    m_file = ::_open_osfhandle(reinterpret_cast<intptr_t>(handle), _O_WRONLY | _O_BINARY);
+                    if (m_file == -1)
+                    {
+                        CloseHandle(handle);
+                    }
+                }
 #else
                 m_file = ::open(fileName, O_CREAT | O_WRONLY, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
 #endif
@@ -261,6 +337,16 @@ namespace plog
                 return write(str.data(), str.size() * sizeof(CharType));
             }
 
+            // Commit written data to the storage device
+            int sync()
+            {
+#ifdef _WIN32
+                return m_file != -1 ? ::_commit(m_file) : -1;
+#else
+                return m_file != -1 ? ::fsync(m_file) : -1;
+#endif
+            }
+
             off_t seek(off_t offset, int whence)
             {
 #ifdef _WIN32
@@ -283,6 +369,13 @@ namespace plog
                 }
             }
 
+            void swap(File& other)
+            {
+                int file = m_file;
+                m_file = other.m_file;
+                other.m_file = file;
+            }
+
             static int unlink(const nchar* fileName)
             {
 #ifdef _WIN32
@@ -79,6 +79,27 @@ namespace plog
         const DWORD kDword = 4;
     }
 
+    namespace fileAccess
+    {
+        const DWORD kGenericWrite = 0x40000000;
+    }
+
+    namespace fileShare
+    {
+        const DWORD kRead = 0x00000001;
+        const DWORD kDelete = 0x00000004;
+    }
+
+    namespace fileCreation
+    {
+        const DWORD kOpenAlways = 4;
+    }
+
+    namespace fileAttribute
+    {
+        const DWORD kNormal = 0x00000080;
+    }
+
     namespace stdHandle
     {
         const DWORD kOutput = static_cast<DWORD>(-11);
@@ -108,6 +129,8 @@ namespace plog
         __declspec(dllimport) DWORD __stdcall GetCurrentThreadId();
 
         __declspec(dllimport) BOOL __stdcall MoveFileW(LPCWSTR lpExistingFileName, LPCWSTR lpNewFileName);
+        __declspec(dllimport) HANDLE __stdcall CreateFileW(LPCWSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode, void* lpSecurityAttributes, DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE hTemplateFile);
+        __declspec(dllimport) BOOL __stdcall CloseHandle(HANDLE hObject);
 
         __declspec(dllimport) void __stdcall InitializeCriticalSection(CRITICAL_SECTION* lpCriticalSection);
         __declspec(dllimport) void __stdcall EnterCriticalSection(CRITICAL_SECTION* lpCriticalSection);
@@ -0,0 +1,398 @@
+#pragma once
+
+#include <plog/Appenders/IAppender.h>
+#include <plog/Util.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "cacheline.h"
+
+namespace plog
+{
+    // Copy of a record that outlives the logging call. The message is copied
+    // into the record's inline buffer and the function name is shortened only
+    // when an appender asks for it, so queueing a record does not allocate.
+    class RecordSnapshot : public Record
+    {
+    public:
+        RecordSnapshot()
+            : Record(none, "", 0, "", 0)
+            , m_time()
+            , m_monotonicNanos()
+            , m_blockPosition()
+            , m_severity(none)
+            , m_tid()
+            , m_object()
+            , m_line()
+            , m_rawFunc("")
+            , m_file("")
+            , m_funcProcessed(false)
+#if PLOG_CAPTURE_ARGS
+            , m_rendered(false)
+#endif
+        {
+        }
+
+        void assign(const Record& record)
+        {
+            m_time = record.getTime();
+            m_monotonicNanos = record.getMonotonicNanos();
+            m_blockPosition = record.getBlockPosition();
+            m_severity = record.getSeverity();
+            m_tid = record.getTid();
+            m_object = record.getObject();
+            m_line = record.getLine();
+            m_rawFunc = record.getRawFunc();
+            m_file = record.getFile();
+            m_funcProcessed = false;
+#if PLOG_CAPTURE_ARGS
+            // rendered on the writer thread if an appender asks for the text
+            m_template.assign(record.getTemplate());
+            m_args.assign(record.getArgs());
+            m_rendered = false;
+#else
+            const util::nchar* message = record.getMessage();
+            m_message.clear();
+            m_message.append(message, std::char_traits<util::nchar>::length(message));
+#endif
+        }
+
+        virtual const util::Time& getTime() const { return m_time; }
+        virtual unsigned long long getMonotonicNanos() const { return m_monotonicNanos; }
+        virtual const BlockPosition& getBlockPosition() const { return m_blockPosition; }
+        virtual Severity getSeverity() const { return m_severity; }
+        virtual unsigned int getTid() const { return m_tid; }
+        virtual const void* getObject() const { return m_object; }
+        virtual size_t getLine() const { return m_line; }
+#if PLOG_CAPTURE_ARGS
+        virtual const util::nchar* getMessage() const
+        {
+            if (!m_rendered)
+            {
+                arg::render(m_template, m_args, m_messageStr);
+                m_rendered = true;
+            }
+            return m_messageStr.c_str();
+        }
+#endif
+        virtual const char* getFunc() const
+        {
+            if (!m_funcProcessed)
+            {
+                m_func = util::processFuncName(m_rawFunc);
+                m_funcProcessed = true;
+            }
+            return m_func.c_str();
+        }
+
+        virtual const char* getRawFunc() const { return m_rawFunc; }
+        virtual const char* getFile() const { return m_file; }
+
+    private:
+        util::Time          m_time;
+        unsigned long long  m_monotonicNanos;
+        BlockPosition       m_blockPosition;
+        Severity            m_severity;
+        unsigned int        m_tid;
+        const void*         m_object;
+        size_t              m_line;
+        const char*         m_rawFunc;
+        const char*         m_file;
+        mutable std::string m_func;
+        mutable bool        m_funcProcessed;
+#if PLOG_CAPTURE_ARGS
+        mutable bool        m_rendered;
+#endif
+    };
+
+    enum OverflowPolicy
+    {
+        dropNewest,     // discard the record being logged
+        dropOldest,     // discard the oldest queued record to make room
+        block           // wait until the writer thread makes room
+    };
+
+    struct AsyncAppenderStats
+    {
+        unsigned long long queued;      // records accepted into the queue
+        unsigned long long dropped;     // records discarded by the overflow policy
+        size_t highWater;               // largest number of records waiting at once
+    };
+
+    // Hands records to a writer thread through a bounded multi-producer queue
+    // (Vyukov's bounded queue). Logging threads copy the record's inline message
+    // into a slot, formatting and file I/O happen on the writer thread.
+    // The writer thread feeds the downstream appenders added with addAppender.
+    class AsyncAppender : public IAppender
+    {
+    public:
+        AsyncAppender(size_t capacity = 1024, OverflowPolicy policy = dropNewest)
+            : m_policy(policy)
+            , m_running(false)
+            , m_stopping(false)
+            , m_writerIdle(false)
+            , m_enqueuePos(0)
+            , m_producers(0)
+            , m_queued(0)
+            , m_dropped(0)
+            , m_highWater(0)
+            , m_dequeuePos(0)
+        {
+            size_t size = 2;
+            while (size < capacity)
+                size <<= 1;
+
+            m_mask = size - 1;
+            m_slots = new Slot[size];
+            for (size_t i = 0; i < size; ++i)
+            {
+                m_slots[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        virtual ~AsyncAppender()
+        {
+            stop();
+            delete[] m_slots;
+        }
+
+        // Downstream appenders must be added before start()
+        AsyncAppender& addAppender(IAppender* appender)
+        {
+            assert(appender != this);
+            m_appenders.push_back(appender);
+            return *this;
+        }
+
+        void start()
+        {
+            if (!m_running.load())
+            {
+                m_stopping.store(false);
+                m_writer = std::thread(&AsyncAppender::run, this);
+                m_running.store(true);
+            }
+        }
+
+        // Joins the writer thread and drains the queue. Producers keep queueing until
+        // the queue is empty, so records reach the appenders in order and from one
+        // thread at a time. Must run before the module is unloaded, see ~Ntpcs.
+        void stop()
+        {
+            if (m_running.load())
+            {
+                m_stopping.store(true);
+                m_wake.notify_one();
+                m_writer.join();
+
+                // producers writing directly wait until the queued records are out
+                std::lock_guard<std::mutex> lock(m_directMutex);
+                drain();
+                m_running.store(false);
+
+                // producers that saw m_running before it was cleared may still be queueing
+                while (m_producers.load() != 0)
+                {
+                    drain();
+                    std::this_thread::yield();
+                }
+                drain();
+            }
+        }
+
+        virtual void write(const Record& record)
+        {
+            // pairs with stop(): either it sees this producer or the producer sees it stopped
+            m_producers.fetch_add(1);
+            if (m_running.load())
+            {
+                enqueue(record);
+                m_producers.fetch_sub(1, std::memory_order_release);
+            }
+            else
+            {
+                m_producers.fetch_sub(1, std::memory_order_release);
+                std::lock_guard<std::mutex> lock(m_directMutex);
+                writeDownstream(record);
+            }
+        }
+
+        AsyncAppenderStats getStats() const
+        {
+            AsyncAppenderStats stats;
+            stats.queued = m_queued.load(std::memory_order_relaxed);
+            stats.dropped = m_dropped.load(std::memory_order_relaxed);
+            stats.highWater = m_highWater.load(std::memory_order_relaxed);
+            return stats;
+        }
+
+    private:
+        struct Slot
+        {
+            std::atomic<size_t> sequence;
+            RecordSnapshot record;
+        };
+
+        void enqueue(const Record& record)
+        {
+            while (!tryEnqueue(record))
+            {
+                if (m_policy == dropNewest)
+                {
+                    m_dropped.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                else if (m_policy == dropOldest)
+                {
+                    if (tryDequeue(false))
+                        m_dropped.fetch_add(1, std::memory_order_relaxed);
+                }
+                else
+                {
+                    m_wake.notify_one();
+                    std::this_thread::yield();
+                }
+            }
+
+            m_queued.fetch_add(1, std::memory_order_relaxed);
+            updateHighWater();
+
+            if (m_writerIdle.load(std::memory_order_relaxed))
+                m_wake.notify_one();
+        }
+
+        bool tryEnqueue(const Record& record)
+        {
+            size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                Slot& slot = m_slots[pos & m_mask];
+                size_t seq = slot.sequence.load(std::memory_order_acquire);
+                ptrdiff_t diff = static_cast<ptrdiff_t>(seq) - static_cast<ptrdiff_t>(pos);
+
+                if (diff == 0)
+                {
+                    if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        slot.record.assign(record);
+                        slot.sequence.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    return false;   // full
+                }
+                else
+                {
+                    pos = m_enqueuePos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // Takes the oldest record and writes it downstream or discards it
+        bool tryDequeue(bool write)
+        {
+            size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                Slot& slot = m_slots[pos & m_mask];
+                size_t seq = slot.sequence.load(std::memory_order_acquire);
+                ptrdiff_t diff = static_cast<ptrdiff_t>(seq) - static_cast<ptrdiff_t>(pos + 1);
+
+                if (diff == 0)
+                {
+                    if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        if (write)
+                            writeDownstream(slot.record);
+                        slot.sequence.store(pos + m_mask + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    return false;   // empty
+                }
+                else
+                {
+                    pos = m_dequeuePos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        void updateHighWater()
+        {
+            size_t depth = m_enqueuePos.load(std::memory_order_relaxed) - m_dequeuePos.load(std::memory_order_relaxed);
+            size_t highWater = m_highWater.load(std::memory_order_relaxed);
+            while (depth > highWater && depth <= m_mask + 1
+                && !m_highWater.compare_exchange_weak(highWater, depth, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        void writeDownstream(const Record& record)
+        {
+            for (std::vector<IAppender*>::iterator it = m_appenders.begin(); it != m_appenders.end(); ++it)
+            {
+                (*it)->write(record);
+            }
+        }
+
+        void drain()
+        {
+            while (tryDequeue(true))
+            {
+            }
+        }
+
+        void run()
+        {
+            for (;;)
+            {
+                bool wrote = false;
+                while (tryDequeue(true))
+                    wrote = true;
+
+                if (!wrote)
+                {
+                    if (m_stopping.load())
+                        break;
+
+                    // producers only notify while idle, the timeout covers a missed wakeup
+                    std::unique_lock<std::mutex> lock(m_wakeMutex);
+                    m_writerIdle.store(true);
+                    m_wake.wait_for(lock, std::chrono::milliseconds(10));
+                    m_writerIdle.store(false);
+                }
+            }
+        }
+
+    private:
+        const OverflowPolicy        m_policy;
+        std::vector<IAppender*>     m_appenders;
+        Slot*                       m_slots;
+        size_t                      m_mask;
+        std::thread                 m_writer;
+        std::atomic<bool>           m_running;
+        std::atomic<bool>           m_stopping;
+        std::atomic<bool>           m_writerIdle;
+        std::mutex                  m_wakeMutex;
+        std::mutex                  m_directMutex;      // writes while not running, and the end of stop()
+        std::condition_variable     m_wake;
+
+        // producers and the writer thread advance their ends on separate cache lines
+        char                        m_enqueuePadding[kCacheLineSize];
+        std::atomic<size_t>         m_enqueuePos;
+        std::atomic<unsigned int>   m_producers;        // inside write()
+        std::atomic<unsigned long long> m_queued;
+        std::atomic<unsigned long long> m_dropped;
+        std::atomic<size_t>         m_highWater;
+        char                        m_dequeuePadding[kCacheLineSize];
+        std::atomic<size_t>         m_dequeuePos;
+        char                        m_trailingPadding[kCacheLineSize];
+    };
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <plog/Appenders/IAppender.h>
+#include <plog/Util.h>
+#include <vector>
+#include "binarylog.h"
+#include "rollingfile.h"
+
+#if PLOG_CAPTURE_ARGS
+
+static_assert(binlog::kArgMarker == plog::arg::kMarker, "binary log and records mark arguments alike");
+static_assert(binlog::kArgInt == plog::arg::kInt && binlog::kArgUnsigned == plog::arg::kUnsigned
+    && binlog::kArgDouble == plog::arg::kDouble, "binary log and records type arguments alike");
+
+namespace plog
+{
+    // Writes records in the compact layout of binarylog.h and rolls files like
+    // RollingFileAppender. Use the logdecode tool to turn the files back into text.
+    //
+    // Needs PLOG_CAPTURE_ARGS: records arrive with their literal text and typed
+    // arguments apart, so writing one formats nothing. A call site is found by a
+    // hash of its function, line and text in an open-addressing table.
+    class BinaryFileAppender : public IAppender
+    {
+    public:
+        BinaryFileAppender(const util::nchar* fileName, size_t maxFileSize = 0, int maxFiles = 0)
+            : m_file(fileName, maxFileSize, maxFiles, header())
+            , m_prevTime()
+            , m_index(kInitialIndexSize, kNoCallSite)
+        {
+        }
+
+#ifdef _WIN32
+        BinaryFileAppender(const char* fileName, size_t maxFileSize = 0, int maxFiles = 0)
+            : m_file(util::toWide(fileName).c_str(), maxFileSize, maxFiles, header())
+            , m_prevTime()
+            , m_index(kInitialIndexSize, kNoCallSite)
+        {
+        }
+#endif
+
+        // Starts and stops the thread that rolls the files, see RollingFile
+        void start()
+        {
+            m_file.start();
+        }
+
+        void stop()
+        {
+            m_file.stop();
+        }
+
+        virtual void write(const Record& record)
+        {
+            util::MutexLock lock(m_mutex);
+
+            // every file is decodable on its own, call site id 0 restarts the table
+            if (m_file.prepare())
+            {
+                m_callSites.clear();
+                m_index.assign(m_index.size(), kNoCallSite);
+                m_prevTime = 0;
+            }
+
+            m_buffer.clear();
+            unsigned int site = findCallSite(record);
+
+            long long time = static_cast<long long>(record.getTime().time) * 1000 + record.getTime().millitm;
+            m_buffer += char(binlog::kTagRecord);
+            binlog::putZigzag(m_buffer, time - m_prevTime);
+            binlog::putVarint(m_buffer, site);
+            m_prevTime = time;
+
+            // arguments were captured typed where the record was logged
+            const arg::Args& args = record.getArgs();
+            for (size_t i = 0; i + arg::kSize <= args.size(); i += arg::kSize)
+            {
+                const char* value = args.data() + i + 1;
+                m_buffer += args[i];
+                if (args[i] == arg::kInt)
+                {
+                    long long v;
+                    memcpy(&v, value, 8);
+                    binlog::putZigzag(m_buffer, v);
+                }
+                else if (args[i] == arg::kUnsigned)
+                {
+                    unsigned long long v;
+                    memcpy(&v, value, 8);
+                    binlog::putVarint(m_buffer, v);
+                }
+                else
+                {
+                    double v;
+                    memcpy(&v, value, 8);
+                    binlog::putDouble(m_buffer, v);
+                }
+            }
+
+            m_file.write(m_buffer.data(), m_buffer.size());
+        }
+
+    private:
+        struct CallSite
+        {
+            unsigned long long hash;
+            size_t line;
+            std::string func;
+            std::string tmpl;
+        };
+
+        enum { kNoCallSite = -1 };
+        static const size_t kInitialIndexSize = 256;
+
+        static std::string header()
+        {
+            std::string header(kBinaryLogMagic, kBinaryLogMagicLength);
+            header += char(kBinaryLogVersion);
+            return header;
+        }
+
+        // FNV-1a over 8-byte words, a match is confirmed by comparing the call site
+        static unsigned long long hashBytes(unsigned long long hash, const char* data, size_t size)
+        {
+            size_t i = 0;
+            for (; i + 8 <= size; i += 8)
+            {
+                unsigned long long word;
+                memcpy(&word, data + i, 8);
+                hash = (hash ^ word) * 1099511628211ULL;
+            }
+            for (; i < size; ++i)
+            {
+                hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ULL;
+            }
+            return hash ^ (hash >> 29);
+        }
+
+        // Returns the id of the record's call site, defining it in the file first if it is new
+        unsigned int findCallSite(const Record& record)
+        {
+            const char* func = record.getFunc();
+            size_t funcLength = ::strlen(func);
+            size_t line = record.getLine();
+            const arg::Template& tmpl = record.getTemplate();
+
+            unsigned long long hash = hashBytes(14695981039346656037ULL, func, funcLength);
+            hash = hashBytes(hash, reinterpret_cast<const char*>(&line), sizeof(line));
+            hash = hashBytes(hash, tmpl.data(), tmpl.size());
+
+            size_t mask = m_index.size() - 1;
+            size_t slot = static_cast<size_t>(hash) & mask;
+            for (; m_index[slot] != kNoCallSite; slot = (slot + 1) & mask)
+            {
+                const CallSite& site = m_callSites[m_index[slot]];
+                if (site.hash == hash && site.line == line && site.tmpl.compare(0, std::string::npos, tmpl.data(), tmpl.size()) == 0 && site.func.compare(0, std::string::npos, func, funcLength) == 0)
+                    return static_cast<unsigned int>(m_index[slot]);
+            }
+
+            unsigned int id = static_cast<unsigned int>(m_callSites.size());
+            CallSite site = { hash, line, std::string(func, funcLength), std::string(tmpl.data(), tmpl.size()) };
+            m_callSites.push_back(site);
+            m_index[slot] = static_cast<int>(id);
+            if (m_callSites.size() * 2 > m_index.size())
+                growIndex();
+
+            m_buffer += char(binlog::kTagCallSite);
+            binlog::putVarint(m_buffer, id);
+            m_buffer += char(record.getSeverity());
+            binlog::putString(m_buffer, func, funcLength);
+            binlog::putVarint(m_buffer, line);
+            binlog::putString(m_buffer, tmpl.data(), tmpl.size());
+            return id;
+        }
+
+        void growIndex()
+        {
+            m_index.assign(m_index.size() * 2, kNoCallSite);
+            size_t mask = m_index.size() - 1;
+            for (unsigned int id = 0; id < m_callSites.size(); ++id)
+            {
+                size_t slot = static_cast<size_t>(m_callSites[id].hash) & mask;
+                while (m_index[slot] != kNoCallSite)
+                    slot = (slot + 1) & mask;
+                m_index[slot] = static_cast<int>(id);
+            }
+        }
+
+    private:
+        util::Mutex     m_mutex;
+        RollingFile     m_file;
+        long long       m_prevTime;
+        std::vector<CallSite> m_callSites;  // indexed by id
+        std::vector<int> m_index;           // hash slots holding call site ids
+        std::string     m_buffer;
+    };
+}
+
+#endif
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+// Binary debug log layout (shared by BinaryFileAppender and the logdecode tool)
+//
+//   file      := magic version record*
+//   record    := kTagCallSite varint(id) u8(severity) str(func) varint(line) str(template)
+//              | kTagRecord zigzag(delta ms) varint(id) arg*
+//   arg       := u8(kArgInt) zigzag(value)                   one per kArgMarker in template
+//              | u8(kArgUnsigned) varint(value)
+//              | u8(kArgDouble) 8 bytes (IEEE 754, little-endian)
+//   str       := varint(length) bytes
+//
+// Numbers streamed into a message are captured as typed args where they are
+// logged (PLOG_CAPTURE_ARGS), so the text of a call site is written only once
+// per file. Defining call site 0 starts a new table and
+// resets the time base, which happens at the start of every file and when a
+// process appends to an existing file.
+
+#define kBinaryLogMagic "NTPCSLOG"
+#define kBinaryLogMagicLength 8
+#define kBinaryLogVersion 2
+
+namespace binlog
+{
+    const unsigned char kTagCallSite = 1;
+    const unsigned char kTagRecord = 2;
+    const char kArgMarker = '\x1f';
+    const unsigned char kArgInt = 1;
+    const unsigned char kArgUnsigned = 2;
+    const unsigned char kArgDouble = 3;
+
+    inline void putVarint(std::string& out, unsigned long long value)
+    {
+        while (value >= 0x80)
+        {
+            out += char((value & 0x7f) | 0x80);
+            value >>= 7;
+        }
+        out += char(value);
+    }
+
+    inline void putZigzag(std::string& out, long long value)
+    {
+        putVarint(out, (static_cast<unsigned long long>(value) << 1) ^ static_cast<unsigned long long>(value >> 63));
+    }
+
+    inline void putString(std::string& out, const char* str, size_t length)
+    {
+        putVarint(out, length);
+        out.append(str, length);
+    }
+
+    inline bool getVarint(const unsigned char*& pos, const unsigned char* end, unsigned long long& value)
+    {
+        value = 0;
+        for (int shift = 0; pos < end && shift < 64; shift += 7)
+        {
+            unsigned char byte = *pos++;
+            value |= static_cast<unsigned long long>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    inline bool getZigzag(const unsigned char*& pos, const unsigned char* end, long long& value)
+    {
+        unsigned long long raw;
+        if (!getVarint(pos, end, raw))
+            return false;
+        value = static_cast<long long>(raw >> 1) ^ -static_cast<long long>(raw & 1);
+        return true;
+    }
+
+    inline bool getString(const unsigned char*& pos, const unsigned char* end, std::string& str)
+    {
+        unsigned long long length;
+        if (!getVarint(pos, end, length) || length > static_cast<unsigned long long>(end - pos))
+            return false;
+        str.assign(reinterpret_cast<const char*>(pos), static_cast<size_t>(length));
+        pos += length;
+        return true;
+    }
+
+    inline void putDouble(std::string& out, double value)
+    {
+        unsigned long long bits;
+        memcpy(&bits, &value, sizeof(bits));
+        for (int i = 0; i < 8; ++i)
+            out += char((bits >> (8 * i)) & 0xff);
+    }
+
+    inline bool getDouble(const unsigned char*& pos, const unsigned char* end, double& value)
+    {
+        if (end - pos < 8)
+            return false;
+        unsigned long long bits = 0;
+        for (int i = 0; i < 8; ++i)
+            bits |= static_cast<unsigned long long>(*pos++) << (8 * i);
+        memcpy(&value, &bits, sizeof(value));
+        return true;
+    }
+
+    // Appends one argument as streaming it into the message would have printed it
+    inline bool renderArg(const unsigned char*& pos, const unsigned char* end, std::string& out)
+    {
+        if (pos >= end)
+            return false;
+
+        char text[32];
+        unsigned char type = *pos++;
+        if (type == kArgInt)
+        {
+            long long value;
+            if (!getZigzag(pos, end, value))
+                return false;
+            snprintf(text, sizeof(text), "%lld", value);
+        }
+        else if (type == kArgUnsigned)
+        {
+            unsigned long long value;
+            if (!getVarint(pos, end, value))
+                return false;
+            snprintf(text, sizeof(text), "%llu", value);
+        }
+        else if (type == kArgDouble)
+        {
+            double value;
+            if (!getDouble(pos, end, value))
+                return false;
+            snprintf(text, sizeof(text), "%g", value);
+        }
+        else
+        {
+            return false;
+        }
+        out += text;
+        return true;
+    }
+}
@@ -0,0 +1,172 @@
+#include "budgetmonitor.h"
+#include <plog/Util.h>
+#include <chrono>
+#include <thread>
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#define kBudgetCycleCounter 1
+#elif defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#define kBudgetCycleCounter 1
+#else
+#define kBudgetCycleCounter 0
+#endif
+
+BudgetMonitor::BudgetMonitor()
+    : block_cycles_(0)
+    , blocks_(0)
+    , overruns_(0)
+    , last_permyriad_(0)
+    , worst_permyriad_(0)
+    , overrun_permyriad_(static_cast<unsigned int>(kBudgetOverrunThreshold * 10000))
+    , reset_requested_(false)
+{
+    for (unsigned int i = 0; i < kBudgetHistogramBins; ++i)
+    {
+        histogram_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void BudgetMonitor::setOverrunThreshold(double fraction)
+{
+    overrun_permyriad_.store(static_cast<unsigned int>(fraction * 10000), std::memory_order_relaxed);
+}
+
+double BudgetMonitor::getOverrunThreshold() const
+{
+    return overrun_permyriad_.load(std::memory_order_relaxed) / 10000.0;
+}
+
+unsigned long long BudgetMonitor::begin() const
+{
+    return readCycleCounter();
+}
+
+void BudgetMonitor::end(unsigned long long begin_cycles)
+{
+    block_cycles_ += readCycleCounter() - begin_cycles;
+}
+
+double BudgetMonitor::endBlock(VstInt32 sample_frames, double sample_rate)
+{
+    unsigned long long cycles = block_cycles_;
+    block_cycles_ = 0;
+    if (sample_frames <= 0 || sample_rate <= 0)
+    {
+        return 0;
+    }
+
+    // counters are only written here, so the reset is done by the audio thread
+    if (reset_requested_.exchange(false, std::memory_order_acquire))
+    {
+        for (unsigned int i = 0; i < kBudgetHistogramBins; ++i)
+        {
+            histogram_[i].store(0, std::memory_order_relaxed);
+        }
+        blocks_.store(0, std::memory_order_relaxed);
+        overruns_.store(0, std::memory_order_relaxed);
+        worst_permyriad_.store(0, std::memory_order_relaxed);
+    }
+
+    double budget_cycles = getCyclesPerSecond() * sample_frames / sample_rate;
+    double used = cycles / budget_cycles;
+    unsigned int permyriad = used < 100.0 ? static_cast<unsigned int>(used * 10000) : 1000000;
+
+    unsigned int bin = permyriad / 100;
+    if (bin >= kBudgetHistogramBins)
+    {
+        bin = kBudgetHistogramBins - 1;
+    }
+    histogram_[bin].store(histogram_[bin].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    last_permyriad_.store(permyriad, std::memory_order_relaxed);
+    if (permyriad > worst_permyriad_.load(std::memory_order_relaxed))
+    {
+        worst_permyriad_.store(permyriad, std::memory_order_relaxed);
+    }
+    if (permyriad > overrun_permyriad_.load(std::memory_order_relaxed))
+    {
+        overruns_.store(overruns_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    blocks_.store(blocks_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+
+    return used;
+}
+
+// Counters are read one by one, so the result can mix two neighbouring blocks
+BudgetStats BudgetMonitor::getStats() const
+{
+    BudgetStats stats;
+    stats.blocks = blocks_.load(std::memory_order_acquire);
+    stats.overruns = overruns_.load(std::memory_order_relaxed);
+    stats.last = last_permyriad_.load(std::memory_order_relaxed) / 10000.0;
+    stats.worst = worst_permyriad_.load(std::memory_order_relaxed) / 10000.0;
+
+    unsigned int bins[kBudgetHistogramBins];
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < kBudgetHistogramBins; ++i)
+    {
+        bins[i] = histogram_[i].load(std::memory_order_relaxed);
+        count += bins[i];
+    }
+    stats.p50 = getPercentile(bins, count, 0.50);
+    stats.p95 = getPercentile(bins, count, 0.95);
+    stats.p99 = getPercentile(bins, count, 0.99);
+    return stats;
+}
+
+// takes effect at the end of the next block
+void BudgetMonitor::reset()
+{
+    reset_requested_.store(true, std::memory_order_release);
+}
+
+// upper edge of the bin that contains the percentile
+double BudgetMonitor::getPercentile(const unsigned int* bins, unsigned int count, double fraction) const
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    unsigned int rank = static_cast<unsigned int>(fraction * count);
+    unsigned int seen = 0;
+    for (unsigned int i = 0; i < kBudgetHistogramBins; ++i)
+    {
+        seen += bins[i];
+        if (seen > rank)
+        {
+            return (i + 1) / 100.0;
+        }
+    }
+    return kBudgetHistogramBins / 100.0;
+}
+
+unsigned long long BudgetMonitor::readCycleCounter()
+{
+#if kBudgetCycleCounter
+    return __rdtsc();
+#else
+    return plog::util::monotonicNanos();
+#endif
+}
+
+// Assumes an invariant time stamp counter, as on all CPUs the plugin targets
+double BudgetMonitor::getCyclesPerSecond()
+{
+#if kBudgetCycleCounter
+    static const double cycles_per_second = []()
+    {
+        unsigned long long begin_ns = plog::util::monotonicNanos();
+        unsigned long long begin_cycles = __rdtsc();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        unsigned long long end_cycles = __rdtsc();
+        unsigned long long end_ns = plog::util::monotonicNanos();
+        return (end_cycles - begin_cycles) * 1e9 / (end_ns - begin_ns);
+    }();
+    return cycles_per_second;
+#else
+    return 1e9;
+#endif
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include "audioeffectx.h"
+
+#define kBudgetHistogramBins 200        // 1% wide bins, the last one collects everything above
+#define kBudgetOverrunThreshold 0.75    // default fraction of the block budget counted as overrun
+
+struct BudgetStats
+{
+    unsigned int blocks;        // blocks measured
+    unsigned int overruns;      // blocks above the overrun threshold
+    double last;                // budget used by the latest block (1.0 = whole block)
+    double worst;
+    double p50;
+    double p95;
+    double p99;
+};
+
+// Measures how much of the real-time budget (sample_frames / sample rate) each
+// block spends in processEvents and processReplacing.
+//
+// Timing uses the CPU time stamp counter where available, calibrated once against
+// the monotonic clock. begin/end and endBlock are called by the audio thread and
+// only touch atomics written by that thread, getStats and reset can be called from
+// any thread.
+class BudgetMonitor
+{
+public:
+    BudgetMonitor();
+    void setOverrunThreshold(double fraction);
+    double getOverrunThreshold() const;
+
+    // brackets one processEvents or processReplacing call
+    unsigned long long begin() const;
+    void end(unsigned long long begin_cycles);
+
+    // closes the block, processEvents calls since the previous block count into it
+    // returns the fraction of the budget used
+    double endBlock(VstInt32 sample_frames, double sample_rate);
+
+    BudgetStats getStats() const;
+    void reset();
+
+    static unsigned long long readCycleCounter();
+
+    // the first call calibrates for 20 ms, make it outside the audio thread
+    static double getCyclesPerSecond();
+
+private:
+    double getPercentile(const unsigned int* bins, unsigned int count, double fraction) const;
+
+    unsigned long long block_cycles_;       // cycles spent in the current block so far
+    std::atomic<unsigned int> histogram_[kBudgetHistogramBins];
+    std::atomic<unsigned int> blocks_;
+    std::atomic<unsigned int> overruns_;
+    std::atomic<unsigned int> last_permyriad_;      // budget used in 1/10000
+    std::atomic<unsigned int> worst_permyriad_;
+    std::atomic<unsigned int> overrun_permyriad_;   // threshold in 1/10000
+    std::atomic<bool> reset_requested_;
+};
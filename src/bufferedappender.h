@@ -0,0 +1,196 @@
+#pragma once
+
+#include <plog/Appenders/IAppender.h>
+#include <plog/Converters/UTF8Converter.h>
+#include <plog/Util.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "logformat.h"
+#include "rollingfile.h"
+
+namespace plog
+{
+    enum Durability
+    {
+        durabilityNone,     // data reaches the file when the buffer fills or the interval expires
+        durabilityFlush,    // additionally write the buffer to the file every N records
+        durabilityFsync     // additionally write and fsync every N records
+    };
+
+    // RollingFileAppender variant that collects formatted records in a buffer and
+    // writes it with one call when it reaches bufferSize, when the flush interval
+    // expires, when the durability policy asks for it, or on stop().
+    // Records are formatted into a stack buffer outside the lock and the file is
+    // written from a swapped out buffer, so logging threads only hold the lock for
+    // an append and do not allocate once the buffers are reserved.
+    template<class Formatter, class Converter = UTF8Converter>
+    class BufferedFileAppender : public IAppender
+    {
+    public:
+        BufferedFileAppender(const util::nchar* fileName, size_t maxFileSize = 0, int maxFiles = 0, size_t bufferSize = 64 * 1024)
+            : m_file(fileName, maxFileSize, maxFiles, Converter::header(Formatter::header()))
+        {
+            init(bufferSize);
+        }
+
+#ifdef _WIN32
+        BufferedFileAppender(const char* fileName, size_t maxFileSize = 0, int maxFiles = 0, size_t bufferSize = 64 * 1024)
+            : m_file(util::toWide(fileName).c_str(), maxFileSize, maxFiles, Converter::header(Formatter::header()))
+        {
+            init(bufferSize);
+        }
+#endif
+
+        virtual ~BufferedFileAppender()
+        {
+            stop();
+        }
+
+        void setFlushInterval(int milliseconds)
+        {
+            m_flushInterval = milliseconds;
+        }
+
+        void setDurability(Durability durability, int everyRecords)
+        {
+            util::MutexLock lock(m_bufferMutex);
+            m_durability = durability;
+            m_syncEvery = (std::max)(everyRecords, 1);
+            m_pendingRecords = 0;
+        }
+
+        // Starts the thread that flushes the buffer every flush interval
+        // and the one that rolls the files
+        void start()
+        {
+            m_file.start();
+            if (!m_flusher.joinable())
+            {
+                m_stopping = false;
+                m_flusher = std::thread(&BufferedFileAppender::run, this);
+            }
+        }
+
+        // Joins the threads and writes out the buffer. Must run before the module
+        // is unloaded, see ~Ntpcs.
+        void stop()
+        {
+            if (m_flusher.joinable())
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_wakeMutex);
+                    m_stopping = true;
+                }
+                m_wake.notify_one();
+                m_flusher.join();
+            }
+            flush(isFsyncDurability());
+            m_file.stop();
+        }
+
+        virtual void write(const Record& record)
+        {
+            util::nchar text[kMaxRecordLength];
+            char scratch[kMaxRecordLength * 3];
+            size_t length = Formatter::format(record, text, kMaxRecordLength);
+            const char* data = Converter::convert(text, length, scratch, sizeof(scratch));
+            bool full = false;
+            bool commit = false;
+            bool sync = false;
+
+            {
+                util::MutexLock lock(m_bufferMutex);
+                m_buffer.append(data, length);
+                full = m_buffer.size() >= m_bufferSize;
+
+                if (m_durability != durabilityNone && ++m_pendingRecords >= m_syncEvery)
+                {
+                    m_pendingRecords = 0;
+                    commit = true;
+                    sync = m_durability == durabilityFsync;
+                }
+            }
+
+            if (full || commit)
+            {
+                flush(sync);
+            }
+        }
+
+        void flush(bool sync = false)
+        {
+            util::MutexLock fileLock(m_fileMutex);
+            {
+                util::MutexLock lock(m_bufferMutex);
+                m_buffer.swap(m_spare);
+            }
+
+            if (!m_spare.empty())
+            {
+                m_file.prepare();
+                m_file.write(m_spare.data(), m_spare.size());
+                m_spare.clear();
+            }
+
+            if (sync)
+            {
+                m_file.sync();
+            }
+        }
+
+    private:
+        // setDurability may change it from another thread
+        bool isFsyncDurability()
+        {
+            util::MutexLock lock(m_bufferMutex);
+            return m_durability == durabilityFsync;
+        }
+
+        void init(size_t bufferSize)
+        {
+            m_bufferSize = (std::max)(bufferSize, static_cast<size_t>(1024));
+            m_buffer.reserve(m_bufferSize + kMaxRecordReserve);
+            m_spare.reserve(m_bufferSize + kMaxRecordReserve);
+            m_flushInterval = 1000;
+            m_durability = durabilityNone;
+            m_syncEvery = 1;
+            m_pendingRecords = 0;
+            m_stopping = false;
+        }
+
+        void run()
+        {
+            std::unique_lock<std::mutex> lock(m_wakeMutex);
+            while (!m_stopping)
+            {
+                m_wake.wait_for(lock, std::chrono::milliseconds(m_flushInterval));
+                if (!m_stopping)
+                {
+                    lock.unlock();
+                    flush(isFsyncDurability());
+                    lock.lock();
+                }
+            }
+        }
+
+        static const size_t kMaxRecordReserve = 4096;
+
+    private:
+        util::Mutex             m_fileMutex;    // serializes flushes, taken before m_bufferMutex
+        util::Mutex             m_bufferMutex;
+        RollingFile             m_file;
+        std::string             m_buffer;
+        std::string             m_spare;
+        size_t                  m_bufferSize;
+        int                     m_flushInterval;
+        Durability              m_durability;   // guarded by m_bufferMutex, as are the two below
+        int                     m_syncEvery;
+        int                     m_pendingRecords;
+        std::thread             m_flusher;
+        std::mutex              m_wakeMutex;
+        std::condition_variable m_wake;
+        bool                    m_stopping;
+    };
+}
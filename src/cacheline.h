@@ -0,0 +1,6 @@
+#pragma once
+
+// Distance kept between state written by different threads. Plugin instances run
+// on different host threads, and two of them writing to one cache line slow each
+// other down although they share no data.
+#define kCacheLineSize 64
@@ -0,0 +1,619 @@
+#include "capture.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+    enum BlockField
+    {
+        kFieldSamplePos,
+        kFieldSampleRate,
+        kFieldNanoSeconds,
+        kFieldPpqPos,
+        kFieldTempo,
+        kFieldBarStartPos,
+        kFieldCycleStartPos,
+        kFieldCycleEndPos,
+        kFieldTimeSigNumerator,
+        kFieldTimeSigDenominator,
+        kFieldSmpteOffset,
+        kFieldSmpteFrameRate,
+        kFieldSamplesToNextClock,
+        kFieldFlags,
+        kFieldPluginSampleRate,     // AudioEffect::getSampleRate(), may differ from the host's time info
+        kFieldNoTimeInfo,           // getTimeInfo returned NULL
+    };
+
+    double* getDoubleField(VstTimeInfo& time_info, int field)
+    {
+        switch (field)
+        {
+        case kFieldSamplePos: return &time_info.samplePos;
+        case kFieldSampleRate: return &time_info.sampleRate;
+        case kFieldNanoSeconds: return &time_info.nanoSeconds;
+        case kFieldPpqPos: return &time_info.ppqPos;
+        case kFieldTempo: return &time_info.tempo;
+        case kFieldBarStartPos: return &time_info.barStartPos;
+        case kFieldCycleStartPos: return &time_info.cycleStartPos;
+        case kFieldCycleEndPos: return &time_info.cycleEndPos;
+        }
+        return NULL;
+    }
+
+    VstInt32* getIntField(VstTimeInfo& time_info, int field)
+    {
+        switch (field)
+        {
+        case kFieldTimeSigNumerator: return &time_info.timeSigNumerator;
+        case kFieldTimeSigDenominator: return &time_info.timeSigDenominator;
+        case kFieldSmpteOffset: return &time_info.smpteOffset;
+        case kFieldSmpteFrameRate: return &time_info.smpteFrameRate;
+        case kFieldSamplesToNextClock: return &time_info.samplesToNextClock;
+        case kFieldFlags: return &time_info.flags;
+        }
+        return NULL;
+    }
+
+    // Fixed-size output, sets ok to false instead of overflowing
+    struct Encoder
+    {
+        Encoder(unsigned char* begin, unsigned char* end) : pos(begin), end(end), ok(true) {}
+
+        void putByte(unsigned char value)
+        {
+            if (pos < end)
+                *pos++ = value;
+            else
+                ok = false;
+        }
+
+        void putVarint(unsigned long long value)
+        {
+            while (value >= 0x80)
+            {
+                putByte(static_cast<unsigned char>(value | 0x80));
+                value >>= 7;
+            }
+            putByte(static_cast<unsigned char>(value));
+        }
+
+        void putZigzag(long long value)
+        {
+            putVarint((static_cast<unsigned long long>(value) << 1) ^ static_cast<unsigned long long>(value >> 63));
+        }
+
+        // byte order of the host, which is little-endian on every target
+        void putDouble(double value)
+        {
+            putBytes(&value, sizeof(value));
+        }
+
+        void putBytes(const void* data, size_t size)
+        {
+            if (size == 0)
+            {
+                return;
+            }
+            if (static_cast<size_t>(end - pos) < size)
+            {
+                ok = false;
+                return;
+            }
+            memcpy(pos, data, size);
+            pos += size;
+        }
+
+        unsigned char* pos;
+        unsigned char* end;
+        bool ok;
+    };
+
+    struct Decoder
+    {
+        Decoder(const std::vector<unsigned char>& data, size_t& pos) : data(data), pos(pos), ok(true) {}
+
+        unsigned char getByte()
+        {
+            if (pos < data.size())
+                return data[pos++];
+            ok = false;
+            return 0;
+        }
+
+        unsigned long long getVarint()
+        {
+            unsigned long long value = 0;
+            for (int shift = 0; shift < 64; shift += 7)
+            {
+                unsigned char byte = getByte();
+                value |= static_cast<unsigned long long>(byte & 0x7f) << shift;
+                if (!(byte & 0x80))
+                    return value;
+            }
+            ok = false;
+            return 0;
+        }
+
+        long long getZigzag()
+        {
+            unsigned long long value = getVarint();
+            return static_cast<long long>(value >> 1) ^ -static_cast<long long>(value & 1);
+        }
+
+        double getDouble()
+        {
+            double value = 0;
+            getBytes(&value, sizeof(value));
+            return value;
+        }
+
+        void getBytes(void* out, size_t size)
+        {
+            if (pos > data.size() || data.size() - pos < size)
+            {
+                ok = false;
+                return;
+            }
+            memcpy(out, &data[pos], size);
+            pos += size;
+        }
+
+        const std::vector<unsigned char>& data;
+        size_t& pos;
+        bool ok;
+    };
+}
+
+SessionCapture::SessionCapture()
+    : queue_(new unsigned char[kCaptureQueueBytes])
+    , head_(0)
+    , tail_(0)
+    , prev_sample_rate_(0)
+    , pending_gap_(0)
+    , dropped_records_(0)
+    , file_(NULL)
+    , stopping_(false)
+{
+    memset(&prev_time_info_, 0, sizeof(prev_time_info_));
+}
+
+SessionCapture::~SessionCapture()
+{
+    close();
+    delete[] queue_;
+}
+
+bool SessionCapture::open(const char* file_name)
+{
+    if (file_)
+    {
+        return false;
+    }
+
+    file_ = fopen(file_name, "wb");
+    if (!file_)
+    {
+        return false;
+    }
+
+    fwrite(kCaptureMagic, 1, kCaptureMagicLength, file_);
+    fputc(kCaptureVersion, file_);
+
+    stopping_ = false;
+    writer_ = std::thread(&SessionCapture::run, this);
+    return true;
+}
+
+// Must run before the module is unloaded, see ~Ntpcs.
+void SessionCapture::close()
+{
+    if (!file_)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        stopping_ = true;
+    }
+    wake_.notify_one();
+    writer_.join();
+
+    writeQueue();
+    fclose(file_);
+    file_ = NULL;
+}
+
+void SessionCapture::captureEvents(const VstEvents* events)
+{
+    Encoder out(record_, record_ + kCaptureMaxRecordBytes);
+    if (pending_gap_ > 0)
+    {
+        out.putByte(kCaptureGap);
+        out.putVarint(pending_gap_);
+    }
+
+    VstInt32 count = 0;
+    for (VstInt32 i = 0; i < events->numEvents; ++i)
+    {
+        VstInt32 type = events->events[i]->type;
+        if (type == kVstMidiType || type == kVstSysExType)
+            ++count;
+    }
+
+    out.putByte(kCaptureEvents);
+    out.putVarint(count);
+    for (VstInt32 i = 0; i < events->numEvents && out.ok; ++i)
+    {
+        const VstEvent* ev = events->events[i];
+        if (ev->type == kVstMidiType)
+        {
+            const VstMidiEvent* midi = (const VstMidiEvent*)ev;
+            out.putVarint(midi->type);
+            out.putZigzag(midi->deltaFrames);
+            out.putVarint(midi->flags);
+            out.putZigzag(midi->noteLength);
+            out.putZigzag(midi->noteOffset);
+            out.putBytes(midi->midiData, 4);
+            out.putByte(midi->detune);
+            out.putByte(midi->noteOffVelocity);
+        }
+        else if (ev->type == kVstSysExType)
+        {
+            const VstMidiSysexEvent* sysex = (const VstMidiSysexEvent*)ev;
+            VstInt32 dump_bytes = sysex->dumpBytes > 0 ? sysex->dumpBytes : 0;
+            out.putVarint(sysex->type);
+            out.putZigzag(sysex->deltaFrames);
+            out.putVarint(sysex->flags);
+            out.putVarint(dump_bytes);
+            out.putBytes(sysex->sysexDump, dump_bytes);
+        }
+    }
+
+    if (out.ok && push(record_, out.pos - record_))
+    {
+        pending_gap_ = 0;
+    }
+    else
+    {
+        ++pending_gap_;
+        dropped_records_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void SessionCapture::captureBlock(VstInt32 sample_frames, float sample_rate, const VstTimeInfo* time_info)
+{
+    Encoder out(record_, record_ + kCaptureMaxRecordBytes);
+    if (pending_gap_ > 0)
+    {
+        out.putByte(kCaptureGap);
+        out.putVarint(pending_gap_);
+    }
+
+    VstTimeInfo current = time_info ? *time_info : prev_time_info_;
+    unsigned int mask = 0;
+    for (int field = kFieldSamplePos; field <= kFieldFlags; ++field)
+    {
+        double* value = getDoubleField(current, field);
+        if (value && memcmp(value, getDoubleField(prev_time_info_, field), sizeof(double)) != 0)
+            mask |= 1 << field;
+
+        VstInt32* int_value = getIntField(current, field);
+        if (int_value && *int_value != *getIntField(prev_time_info_, field))
+            mask |= 1 << field;
+    }
+    if (sample_rate != prev_sample_rate_)
+        mask |= 1 << kFieldPluginSampleRate;
+    if (!time_info)
+        mask = (mask & (1 << kFieldPluginSampleRate)) | (1 << kFieldNoTimeInfo);
+
+    out.putByte(kCaptureBlock);
+    out.putVarint(sample_frames);
+    out.putVarint(mask);
+    for (int field = kFieldSamplePos; field <= kFieldFlags; ++field)
+    {
+        if (!(mask & (1 << field)))
+            continue;
+
+        if (double* value = getDoubleField(current, field))
+            out.putDouble(*value);
+        else
+            out.putZigzag(*getIntField(current, field));
+    }
+    if (mask & (1 << kFieldPluginSampleRate))
+        out.putDouble(sample_rate);
+
+    // deltas refer to the last record that reached the queue
+    if (out.ok && push(record_, out.pos - record_))
+    {
+        prev_time_info_ = current;
+        prev_sample_rate_ = sample_rate;
+        pending_gap_ = 0;
+    }
+    else
+    {
+        ++pending_gap_;
+        dropped_records_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+unsigned int SessionCapture::getDroppedRecordCount() const
+{
+    return dropped_records_.load(std::memory_order_relaxed);
+}
+
+SessionCapture* SessionCapture::createFromEnvironment()
+{
+    static std::atomic<int> instances(0);
+
+    const char* env = std::getenv("NTPCS_CAPTURE");
+    if (!env || !*env)
+    {
+        return NULL;
+    }
+
+    std::string file_name(env);
+    int instance = ++instances;
+    if (instance > 1)
+    {
+        char suffix[16];
+        snprintf(suffix, sizeof(suffix), ".%d", instance);
+
+        size_t dot = file_name.find_last_of('.');
+        size_t slash = file_name.find_last_of("/\\");
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+            file_name += suffix;
+        else
+            file_name.insert(dot, suffix);
+    }
+
+    SessionCapture* capture = new SessionCapture();
+    if (!capture->open(file_name.c_str()))
+    {
+        delete capture;
+        return NULL;
+    }
+    return capture;
+}
+
+// copies the whole record or nothing
+bool SessionCapture::push(const unsigned char* data, size_t size)
+{
+    size_t head = head_.load(std::memory_order_relaxed);
+    if (size > kCaptureQueueBytes - (head - tail_.load(std::memory_order_acquire)))
+    {
+        return false;
+    }
+
+    size_t index = head % kCaptureQueueBytes;
+    size_t first = (std::min)(size, static_cast<size_t>(kCaptureQueueBytes) - index);
+    memcpy(queue_ + index, data, first);
+    memcpy(queue_, data + first, size - first);
+    head_.store(head + size, std::memory_order_release);
+    return true;
+}
+
+void SessionCapture::run()
+{
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    while (!stopping_)
+    {
+        wake_.wait_for(lock, std::chrono::milliseconds(kCaptureWriteInterval));
+        lock.unlock();
+        writeQueue();
+        lock.lock();
+    }
+}
+
+size_t SessionCapture::writeQueue()
+{
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    size_t size = head_.load(std::memory_order_acquire) - tail;
+    if (size == 0)
+    {
+        return 0;
+    }
+
+    size_t index = tail % kCaptureQueueBytes;
+    size_t first = (std::min)(size, static_cast<size_t>(kCaptureQueueBytes) - index);
+    fwrite(queue_ + index, 1, first, file_);
+    fwrite(queue_, 1, size - first, file_);
+    tail_.store(tail + size, std::memory_order_release);
+    return size;
+}
+
+CaptureReader::CaptureReader()
+    : pos_(0)
+    , valid_(false)
+    , has_time_info_(true)
+    , sample_rate_(0)
+    , sample_frames_(0)
+    , gap_(0)
+{
+    memset(&time_info_, 0, sizeof(time_info_));
+}
+
+CaptureReader::~CaptureReader()
+{
+}
+
+bool CaptureReader::open(const char* file_name)
+{
+    FILE* file = fopen(file_name, "rb");
+    if (!file)
+    {
+        return false;
+    }
+
+    unsigned char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0)
+    {
+        data_.insert(data_.end(), buf, buf + n);
+    }
+    fclose(file);
+
+    valid_ = data_.size() > kCaptureMagicLength
+        && memcmp(&data_[0], kCaptureMagic, kCaptureMagicLength) == 0
+        && data_[kCaptureMagicLength] == kCaptureVersion;
+    pos_ = kCaptureMagicLength + 1;
+    return valid_;
+}
+
+int CaptureReader::next()
+{
+    if (!valid_ || pos_ >= data_.size())
+    {
+        return 0;
+    }
+
+    int tag = data_[pos_++];
+    bool ok = false;
+    switch (tag)
+    {
+    case kCaptureEvents:
+        ok = readEvents();
+        break;
+    case kCaptureBlock:
+        ok = readBlock();
+        break;
+    case kCaptureGap:
+        {
+            Decoder in(data_, pos_);
+            gap_ = static_cast<unsigned int>(in.getVarint());
+            ok = in.ok;
+        }
+        break;
+    }
+
+    if (!ok)
+    {
+        valid_ = false;
+        return 0;
+    }
+    return tag;
+}
+
+// false after a truncated or corrupt record
+bool CaptureReader::isValid() const
+{
+    return valid_;
+}
+
+VstEvents* CaptureReader::getEvents()
+{
+    return (VstEvents*)&events_storage_[0];
+}
+
+VstInt32 CaptureReader::getSampleFrames() const
+{
+    return sample_frames_;
+}
+
+float CaptureReader::getSampleRate() const
+{
+    return sample_rate_;
+}
+
+// NULL when the host returned no time info for the block
+const VstTimeInfo* CaptureReader::getTimeInfo() const
+{
+    return has_time_info_ ? &time_info_ : NULL;
+}
+
+unsigned int CaptureReader::getGap() const
+{
+    return gap_;
+}
+
+bool CaptureReader::readEvents()
+{
+    Decoder in(data_, pos_);
+    size_t count = static_cast<size_t>(in.getVarint());
+    if (!in.ok || count > data_.size())
+    {
+        return false;
+    }
+
+    // reserved up front, so the event pointers stay valid while filling
+    midi_events_.clear();
+    midi_events_.reserve(count);
+    sysex_events_.clear();
+    sysex_events_.reserve(count);
+    sysex_dumps_.clear();
+    sysex_dumps_.reserve(count);
+    events_storage_.assign(sizeof(VstEvents) + count * sizeof(VstEvent*), 0);
+    VstEvents* events = getEvents();
+    events->numEvents = static_cast<VstInt32>(count);
+
+    for (size_t i = 0; i < count && in.ok; ++i)
+    {
+        VstInt32 type = static_cast<VstInt32>(in.getVarint());
+        if (type == kVstMidiType)
+        {
+            VstMidiEvent midi;
+            memset(&midi, 0, sizeof(midi));
+            midi.type = kVstMidiType;
+            midi.byteSize = sizeof(VstMidiEvent);
+            midi.deltaFrames = static_cast<VstInt32>(in.getZigzag());
+            midi.flags = static_cast<VstInt32>(in.getVarint());
+            midi.noteLength = static_cast<VstInt32>(in.getZigzag());
+            midi.noteOffset = static_cast<VstInt32>(in.getZigzag());
+            in.getBytes(midi.midiData, 4);
+            midi.detune = static_cast<char>(in.getByte());
+            midi.noteOffVelocity = static_cast<char>(in.getByte());
+            midi_events_.push_back(midi);
+            events->events[i] = (VstEvent*)&midi_events_.back();
+        }
+        else if (type == kVstSysExType)
+        {
+            VstMidiSysexEvent sysex;
+            memset(&sysex, 0, sizeof(sysex));
+            sysex.type = kVstSysExType;
+            sysex.byteSize = sizeof(VstMidiSysexEvent);
+            sysex.deltaFrames = static_cast<VstInt32>(in.getZigzag());
+            sysex.flags = static_cast<VstInt32>(in.getVarint());
+            size_t dump_bytes = static_cast<size_t>(in.getVarint());
+            if (!in.ok || dump_bytes > data_.size() - pos_)
+            {
+                return false;
+            }
+            sysex_dumps_.push_back(std::string((const char*)&data_[pos_], dump_bytes));
+            pos_ += dump_bytes;
+            sysex.dumpBytes = static_cast<VstInt32>(dump_bytes);
+            sysex.sysexDump = &sysex_dumps_.back()[0];
+            sysex_events_.push_back(sysex);
+            events->events[i] = (VstEvent*)&sysex_events_.back();
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return in.ok;
+}
+
+bool CaptureReader::readBlock()
+{
+    Decoder in(data_, pos_);
+    sample_frames_ = static_cast<VstInt32>(in.getVarint());
+    unsigned int mask = static_cast<unsigned int>(in.getVarint());
+
+    for (int field = kFieldSamplePos; field <= kFieldFlags; ++field)
+    {
+        if (!(mask & (1 << field)))
+            continue;
+
+        if (double* value = getDoubleField(time_info_, field))
+            *value = in.getDouble();
+        else
+            *getIntField(time_info_, field) = static_cast<VstInt32>(in.getZigzag());
+    }
+    if (mask & (1 << kFieldPluginSampleRate))
+        sample_rate_ = static_cast<float>(in.getDouble());
+
+    has_time_info_ = !(mask & (1 << kFieldNoTimeInfo));
+    return in.ok;
+}
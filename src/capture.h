@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "audioeffectx.h"
+#include "cacheline.h"
+
+#define kCaptureQueueBytes (1 << 20)        // bytes the audio thread can queue ahead of the writer
+#define kCaptureMaxRecordBytes (64 * 1024)  // larger event batches are dropped
+#define kCaptureWriteInterval 20            // milliseconds between writes of the writer thread
+
+// Capture file: kCaptureMagic, version byte, then records starting with a tag byte
+//   kCaptureEvents: varint count, per event varint type and its fields
+//   kCaptureBlock:  varint sampleFrames, varint mask of changed fields, changed fields
+//   kCaptureGap:    varint number of records dropped before this one
+// Integers are varints (zigzag if signed), doubles are 8 bytes little-endian.
+const char kCaptureMagic[] = "NTPCSCAP";
+const size_t kCaptureMagicLength = 8;
+const unsigned char kCaptureVersion = 1;
+
+enum CaptureTag
+{
+    kCaptureEvents = 'E',
+    kCaptureBlock = 'B',
+    kCaptureGap = 'G',
+};
+
+// Records the host input of one plugin instance: every processEvents batch and
+// the sampleFrames and VstTimeInfo of every processReplacing call.
+//
+// The audio thread encodes a record into a scratch buffer and copies it into a
+// single-producer single-consumer byte queue. A writer thread moves the queue to
+// the file. Records that do not fit are dropped and a gap record marks the hole.
+class SessionCapture
+{
+public:
+    SessionCapture();
+    ~SessionCapture();
+    bool open(const char* file_name);
+    void close();
+    void captureEvents(const VstEvents*);
+    void captureBlock(VstInt32 sample_frames, float sample_rate, const VstTimeInfo*);
+    unsigned int getDroppedRecordCount() const;
+
+    // Returns an open capture if NTPCS_CAPTURE names a file, NULL otherwise.
+    // Instances after the first write to name.2.ext, name.3.ext, ...
+    static SessionCapture* createFromEnvironment();
+
+private:
+    bool push(const unsigned char*, size_t);
+    void run();
+    size_t writeQueue();
+
+    unsigned char* queue_;
+    char head_padding_[kCacheLineSize];
+    std::atomic<size_t> head_;      // advanced by the audio thread
+    char tail_padding_[kCacheLineSize];
+    std::atomic<size_t> tail_;      // advanced by the writer thread
+    char record_padding_[kCacheLineSize];
+    unsigned char record_[kCaptureMaxRecordBytes];
+    VstTimeInfo prev_time_info_;    // block fields are written when they change
+    float prev_sample_rate_;
+    unsigned int pending_gap_;      // records dropped since the last one that fit
+    std::atomic<unsigned int> dropped_records_;
+    FILE* file_;
+    std::thread writer_;
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    bool stopping_;
+};
+
+// Reads a capture file back, see tools/replay
+class CaptureReader
+{
+public:
+    CaptureReader();
+    ~CaptureReader();
+    bool open(const char* file_name);
+
+    // Returns the tag of the next record or 0 at the end of the file or on error.
+    // The record's data is available through the getters until the next call.
+    int next();
+    bool isValid() const;
+    VstEvents* getEvents();
+    VstInt32 getSampleFrames() const;
+    float getSampleRate() const;
+    const VstTimeInfo* getTimeInfo() const;
+    unsigned int getGap() const;
+
+private:
+    bool readEvents();
+    bool readBlock();
+
+    std::vector<unsigned char> data_;
+    size_t pos_;
+    bool valid_;
+    std::vector<VstMidiEvent> midi_events_;
+    std::vector<VstMidiSysexEvent> sysex_events_;
+    std::vector<std::string> sysex_dumps_;
+    std::vector<char> events_storage_;  // VstEvents with room for all event pointers
+    VstTimeInfo time_info_;
+    bool has_time_info_;
+    float sample_rate_;
+    VstInt32 sample_frames_;
+    unsigned int gap_;
+};
@@ -0,0 +1,132 @@
+#include "clockgenerator.h"
+#include <cmath>
+
+namespace
+{
+    // period of each output in ticks, in ClockOutput bit order
+    const unsigned int kClockOutputPeriods[kClockOutputCount] = {
+        kClockTicksPerBeat / kClocksPerBeat,
+        kClockTicksPerBeat / 48,
+        kClockTicksPerBeat / 96,
+        kClockTicksPerBeat / 4,
+        kClockTicksPerBeat / 2,
+    };
+
+    unsigned int greatestCommonDivisor(unsigned int a, unsigned int b)
+    {
+        while (b != 0)
+        {
+            unsigned int r = a % b;
+            a = b;
+            b = r;
+        }
+        return a;
+    }
+}
+
+ClockGenerator::ClockGenerator()
+{
+    setOutputs(kClockOutputMidiClock);
+    reset();
+}
+
+void ClockGenerator::setOutputs(unsigned int outputs)
+{
+    outputs_ = outputs;
+    stride_ = kClockPatternTicks;
+    for (unsigned int tick = 0; tick < kClockPatternTicks; ++tick)
+    {
+        unsigned int events = 0;
+        for (unsigned int output = 0; output < kClockOutputCount; ++output)
+        {
+            unsigned int bit = 1u << output;
+            if (!(outputs & bit))
+                continue;
+
+            unsigned int period = kClockOutputPeriods[output];
+            if (tick % period == 0)
+                events |= bit;
+            else if (bit != kClockOutputMidiClock && tick % period == period / 2)
+                events |= bit << kClockOutputEndShift;
+        }
+        pattern_[tick] = events;
+        if (events)
+            stride_ = greatestCommonDivisor(stride_, tick);
+    }
+}
+
+unsigned int ClockGenerator::getOutputs() const
+{
+    return outputs_;
+}
+
+void ClockGenerator::reset()
+{
+    phase_ = 1.0;
+    tick_ = 0;
+    block_phase_ = 1.0;
+    block_ticks_per_sample_ = 1.0;
+    block_tick_ = 0;
+    block_ticks_ = 0;
+    next_tick_ = 0;
+}
+
+VstInt32 ClockGenerator::process(double tempo, double sample_rate, VstInt32 sample_frames, VstInt32* delta_frames, unsigned int* events, VstInt32 max_ticks)
+{
+    block_ticks_ = 0;
+    if (tempo <= 0 || sample_rate <= 0 || sample_frames <= 0)
+    {
+        return 0;
+    }
+
+    double ticks_per_sample = tempo * kClockTicksPerBeat / 60.0 / sample_rate;
+    double end_phase = phase_ + sample_frames * ticks_per_sample;
+    block_phase_ = phase_;
+    block_ticks_per_sample_ = ticks_per_sample;
+
+    // Tick n of the block is due where the phase reaches n + 1. The position that
+    // places a tick also decides its block, so a tick on the boundary goes to
+    // sample 0 of the next block and never past the end of this one. The phase
+    // gives the first guess of the tick count.
+    long long ticks = (long long)std::ceil(end_phase) - 1;
+    while (ticks > 0 && tickPosition(ticks - 1) >= sample_frames)
+        --ticks;
+    while (tickPosition(ticks) < sample_frames)
+        ++ticks;
+
+    // the first tick with events is the next multiple of the stride
+    block_tick_ = tick_;
+    block_ticks_ = ticks;
+    next_tick_ = (stride_ - tick_ % stride_) % stride_;
+    tick_ = (unsigned int)((tick_ + ticks) % kClockPatternTicks);
+    phase_ = end_phase - ticks;
+
+    return next(delta_frames, events, max_ticks);
+}
+
+VstInt32 ClockGenerator::next(VstInt32* delta_frames, unsigned int* events, VstInt32 max_ticks)
+{
+    VstInt32 count = 0;
+    for (; next_tick_ < block_ticks_ && count < max_ticks; next_tick_ += stride_)
+    {
+        unsigned int bits = pattern_[(block_tick_ + next_tick_) % kClockPatternTicks];
+        if (bits)
+        {
+            // a tick the last block snapped into this one may be just below 0, the cast makes it 0
+            delta_frames[count] = (VstInt32)tickPosition(next_tick_);
+            events[count] = bits;
+            ++count;
+        }
+    }
+    return count;
+}
+
+double ClockGenerator::tickPosition(long long tick) const
+{
+    return (tick + 1 - block_phase_) / block_ticks_per_sample_ + kClockSnap;
+}
+
+double ClockGenerator::getPhase() const
+{
+    return phase_;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "audioeffectx.h"
+
+#define kClocksPerBeat 24       // MIDI timing clocks per quarter note
+#define kClockTicksPerBeat 192  // resolution of the phase, every output rate divides it
+#define kClockPatternTicks 96   // ticks after which the pattern of every output repeats
+#define kClockSnap 1e-6         // samples below a whole sample that count as on it
+
+// Outputs derived from the tick phase. A tick carries the start bit of each output
+// due at it and, for pulse outputs, the end bit shifted by kClockOutputEndShift.
+enum ClockOutput
+{
+    kClockOutputMidiClock = 1 << 0,     // 24 PPQN timing clock
+    kClockOutputPpqn48 = 1 << 1,        // 48 PPQN DIN sync pulse
+    kClockOutputPpqn96 = 1 << 2,        // 96 PPQN DIN sync pulse
+    kClockOutputSixteenth = 1 << 3,     // 1/16 step trigger
+    kClockOutputEighth = 1 << 4,        // 1/8 step trigger
+};
+#define kClockOutputCount 5
+#define kClockOutputEndShift 8
+
+// Places MIDI timing clocks and sync pulses in consecutive blocks.
+//
+// The position between ticks is kept as a phase in ticks, so the ideal position
+// of every tick is computed from the running phase instead of summing rounded
+// sample offsets, and the error does not grow with the length of the session.
+// Tempo and sample rate may change from block to block, the phase carries over.
+// A tick is sent at the whole sample at or before its ideal position. Positions
+// within kClockSnap below a whole sample are taken as on it: the phase cannot
+// tell them apart from a tick exactly there, which is common at tempos and rates
+// with a small common multiple.
+//
+// All outputs share the phase: only the ticks on the common stride of the enabled
+// outputs are visited, 8 of them a beat for the timing clock alone, and each
+// takes the outputs due at it from a pattern table, so enabling more rates adds
+// no work per divider. Pulses stay high for half their period.
+class ClockGenerator
+{
+public:
+    ClockGenerator();
+
+    // kClockOutput bits to generate
+    void setOutputs(unsigned int outputs);
+    unsigned int getOutputs() const;
+
+    // next block starts with every output at its first sample
+    void reset();
+
+    // Writes the sample offsets of the ticks due in this block with an output to
+    // delta_frames and their start/end bits to events, returns their number. If
+    // more than max_ticks are due, next() returns the rest.
+    VstInt32 process(double tempo, double sample_rate, VstInt32 sample_frames, VstInt32* delta_frames, unsigned int* events, VstInt32 max_ticks);
+
+    // continues the block of the last process(), 0 once all its ticks are written
+    VstInt32 next(VstInt32* delta_frames, unsigned int* events, VstInt32 max_ticks);
+
+    // ticks elapsed since the last tick, in [0, 1] up to the snap
+    double getPhase() const;
+
+private:
+    // position of tick n of the block in samples, snapped, floored it is the offset
+    double tickPosition(long long tick) const;
+
+    unsigned int outputs_;
+    unsigned int pattern_[kClockPatternTicks];  // start/end bits of each tick
+    unsigned int stride_;   // ticks between those with events, divides kClockPatternTicks
+    double phase_;
+    unsigned int tick_;     // position of the next tick in pattern_
+
+    // block of the last process(), the phase and tick_ have moved past it
+    double block_phase_;
+    double block_ticks_per_sample_;
+    unsigned int block_tick_;   // tick_ at the start of the block
+    long long block_ticks_;     // ticks due in the block
+    long long next_tick_;       // next tick of the block on the stride
+};
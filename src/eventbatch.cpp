@@ -0,0 +1,160 @@
+#include "eventbatch.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define kEventBatchVectorWidth 32
+#elif defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define kEventBatchVectorWidth 16
+#else
+#define kEventBatchVectorWidth 0
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace
+{
+    unsigned int countTrailingZeros(unsigned int mask)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return index;
+#else
+        return __builtin_ctz(mask);
+#endif
+    }
+
+    unsigned int countBits(unsigned int mask)
+    {
+        unsigned int count = 0;
+        for (; mask; mask &= mask - 1)
+            ++count;
+        return count;
+    }
+}
+
+EventBatch::EventBatch()
+    : count_(0)
+    , note_event_count_(0)
+    , sysex_event_count_(0)
+    , realtime_event_count_(0)
+{
+}
+
+VstInt32 EventBatch::gather(const VstEvents* events, VstInt32 first)
+{
+    VstInt32 count = events->numEvents - first;
+    if (count > kEventBatchSize)
+        count = kEventBatchSize;
+    if (count < 0)
+        count = 0;
+
+    for (VstInt32 i = 0; i < count; ++i)
+    {
+        const VstEvent* ev = events->events[first + i];
+        if (ev->type == kVstMidiType)
+        {
+            const VstMidiEvent* midi = (const VstMidiEvent*)ev;
+            status_[i] = (unsigned char)midi->midiData[0];
+            data1_[i] = (unsigned char)midi->midiData[1];
+            data2_[i] = (unsigned char)midi->midiData[2];
+            if (status_[i] == 0xF0)
+                status_[i] = 0;     // SysEx only comes as kVstSysExType
+        }
+        else if (ev->type == kVstSysExType)
+        {
+            status_[i] = 0xF0;
+            data1_[i] = 0;
+            data2_[i] = 0;
+        }
+        else
+        {
+            status_[i] = 0;
+            data1_[i] = 0;
+            data2_[i] = 0;
+        }
+        delta_frames_[i] = ev->deltaFrames;
+    }
+
+    // the vector loop reads whole registers, the padding never matches
+    VstInt32 padded = kEventBatchVectorWidth > 0 ? (count + kEventBatchVectorWidth - 1) / kEventBatchVectorWidth * kEventBatchVectorWidth : count;
+    for (VstInt32 i = count; i < padded; ++i)
+    {
+        status_[i] = 0;
+    }
+
+    count_ = count;
+    note_event_count_ = 0;
+    sysex_event_count_ = 0;
+    realtime_event_count_ = 0;
+    return count;
+}
+
+void EventBatch::classify()
+{
+    note_event_count_ = 0;
+    sysex_event_count_ = 0;
+    realtime_event_count_ = 0;
+    VstInt32 i = 0;
+
+#if kEventBatchVectorWidth == 32
+    const __m256i high_nibble = _mm256_set1_epi8((char)0xF0);
+    const __m256i note_off = _mm256_set1_epi8((char)0x80);
+    const __m256i note_on = _mm256_set1_epi8((char)0x90);
+    const __m256i realtime = _mm256_set1_epi8((char)0xF8);
+    const __m256i sysex = _mm256_set1_epi8((char)0xF0);
+    for (; i < count_; i += 32)
+    {
+        __m256i status = _mm256_loadu_si256((const __m256i*)&status_[i]);
+        __m256i kind = _mm256_and_si256(status, high_nibble);
+        __m256i notes = _mm256_or_si256(_mm256_cmpeq_epi8(kind, note_off), _mm256_cmpeq_epi8(kind, note_on));
+        __m256i realtimes = _mm256_cmpeq_epi8(_mm256_max_epu8(status, realtime), status);
+        appendEvents((unsigned int)_mm256_movemask_epi8(notes), i, note_events_, note_event_count_);
+        appendEvents((unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(status, sysex)), i, sysex_events_, sysex_event_count_);
+        realtime_event_count_ += countBits((unsigned int)_mm256_movemask_epi8(realtimes));
+    }
+#elif kEventBatchVectorWidth == 16
+    const __m128i high_nibble = _mm_set1_epi8((char)0xF0);
+    const __m128i note_off = _mm_set1_epi8((char)0x80);
+    const __m128i note_on = _mm_set1_epi8((char)0x90);
+    const __m128i realtime = _mm_set1_epi8((char)0xF8);
+    const __m128i sysex = _mm_set1_epi8((char)0xF0);
+    for (; i < count_; i += 16)
+    {
+        __m128i status = _mm_loadu_si128((const __m128i*)&status_[i]);
+        __m128i kind = _mm_and_si128(status, high_nibble);
+        __m128i notes = _mm_or_si128(_mm_cmpeq_epi8(kind, note_off), _mm_cmpeq_epi8(kind, note_on));
+        __m128i realtimes = _mm_cmpeq_epi8(_mm_max_epu8(status, realtime), status);
+        appendEvents((unsigned int)_mm_movemask_epi8(notes), i, note_events_, note_event_count_);
+        appendEvents((unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(status, sysex)), i, sysex_events_, sysex_event_count_);
+        realtime_event_count_ += countBits((unsigned int)_mm_movemask_epi8(realtimes));
+    }
+#endif
+
+    classifyScalar(i);
+}
+
+void EventBatch::classifyScalar(VstInt32 begin)
+{
+    for (VstInt32 i = begin; i < count_; ++i)
+    {
+        unsigned char kind = status_[i] & 0xF0;
+        if (kind == 0x80 || kind == 0x90)
+            note_events_[note_event_count_++] = (unsigned char)i;
+        else if (status_[i] == 0xF0)
+            sysex_events_[sysex_event_count_++] = (unsigned char)i;
+        else if (status_[i] >= 0xF8)
+            ++realtime_event_count_;
+    }
+}
+
+void EventBatch::appendEvents(unsigned int mask, VstInt32 base, unsigned char* list, VstInt32& count)
+{
+    for (; mask; mask &= mask - 1)
+    {
+        list[count++] = (unsigned char)(base + countTrailingZeros(mask));
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "audioeffectx.h"
+
+#define kEventBatchSize 256     // events gathered per pass, a multiple of 32
+
+// Struct-of-arrays copy of a slice of a VstEvents batch.
+//
+// gather() visits each event pointer once and copies status, data and deltaFrames
+// into flat arrays. classify() then tests the status bytes 16 or 32 at a time
+// (SSE2/AVX2, scalar elsewhere) and lists the note events in their original order,
+// so irrelevant traffic such as controller automation costs one gather per event.
+// SysEx events get status 0xF0 and are listed separately, other event types get
+// status 0 and are never listed.
+class EventBatch
+{
+public:
+    EventBatch();
+
+    // copies up to kEventBatchSize events starting at first, returns their number
+    VstInt32 gather(const VstEvents*, VstInt32 first);
+    void classify();
+
+    VstInt32 getCount() const { return count_; }
+    VstInt32 getNoteEventCount() const { return note_event_count_; }
+    VstInt32 getSysexEventCount() const { return sysex_event_count_; }
+    VstInt32 getRealtimeEventCount() const { return realtime_event_count_; }
+
+    // index within the batch of the n-th note on or note off event
+    VstInt32 getNoteEvent(VstInt32 n) const { return note_events_[n]; }
+
+    // index within the batch of the n-th kVstSysExType event
+    VstInt32 getSysexEvent(VstInt32 n) const { return sysex_events_[n]; }
+
+    unsigned char getStatus(VstInt32 i) const { return status_[i]; }
+    unsigned char getData1(VstInt32 i) const { return data1_[i]; }
+    unsigned char getData2(VstInt32 i) const { return data2_[i]; }
+    VstInt32 getDeltaFrames(VstInt32 i) const { return delta_frames_[i]; }
+
+private:
+    void classifyScalar(VstInt32 begin);
+    static void appendEvents(unsigned int mask, VstInt32 base, unsigned char* list, VstInt32& count);
+
+    unsigned char status_[kEventBatchSize];
+    unsigned char data1_[kEventBatchSize];
+    unsigned char data2_[kEventBatchSize];
+    VstInt32 delta_frames_[kEventBatchSize];
+    unsigned char note_events_[kEventBatchSize];
+    unsigned char sysex_events_[kEventBatchSize];
+    VstInt32 count_;
+    VstInt32 note_event_count_;
+    VstInt32 sysex_event_count_;
+    VstInt32 realtime_event_count_;
+};
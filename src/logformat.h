@@ -0,0 +1,259 @@
+#pragma once
+
+#include <plog/Record.h>
+
+#define kMaxRecordLength 1024   // characters of one formatted record, longer records are truncated
+
+namespace plog
+{
+    namespace pattern
+    {
+        // Write position in a caller-provided buffer. Characters past the end are dropped.
+        struct Cursor
+        {
+            util::nchar* pos;
+            util::nchar* end;
+
+            void put(util::nchar c)
+            {
+                if (pos < end)
+                    *pos++ = c;
+            }
+
+            void putAscii(const char* str)
+            {
+                while (*str)
+                    put(util::nchar(*str++));
+            }
+
+            void putNative(const util::nchar* str)
+            {
+                while (*str)
+                    put(*str++);
+            }
+
+            void putDec(unsigned long long value, int width, util::nchar fill)
+            {
+                util::nchar digits[20];
+                int n = 0;
+                do
+                {
+                    digits[n++] = util::nchar('0' + value % 10);
+                    value /= 10;
+                } while (value != 0);
+
+                for (; width > n; --width)
+                    put(fill);
+                while (n > 0)
+                    put(digits[--n]);
+            }
+
+            void putFixed(double value, int decimals)
+            {
+                if (value < 0)
+                {
+                    put('-');
+                    value = -value;
+                }
+
+                unsigned long long scale = 1;
+                for (int i = 0; i < decimals; ++i)
+                    scale *= 10;
+                unsigned long long fixed = static_cast<unsigned long long>(value * scale + 0.5);
+
+                putDec(fixed / scale, 0, ' ');
+                if (decimals > 0)
+                {
+                    put('.');
+                    putDec(fixed % scale, decimals, '0');
+                }
+            }
+        };
+
+        // "YYYY-MM-DD HH:MM:SS" of the current second, rebuilt only when the second changes
+        class DateTimeCache
+        {
+        public:
+            static const util::nchar* get(time_t time)
+            {
+                static thread_local time_t cached_time = -1;
+                static thread_local util::nchar cached_text[20];
+
+                if (time != cached_time)
+                {
+                    tm t;
+                    util::localtime_s(&t, &time);
+
+                    Cursor out = { cached_text, cached_text + 19 };
+                    out.putDec(t.tm_year + 1900, 4, '0');
+                    out.put('-');
+                    out.putDec(t.tm_mon + 1, 2, '0');
+                    out.put('-');
+                    out.putDec(t.tm_mday, 2, '0');
+                    out.put(' ');
+                    out.putDec(t.tm_hour, 2, '0');
+                    out.put(':');
+                    out.putDec(t.tm_min, 2, '0');
+                    out.put(':');
+                    out.putDec(t.tm_sec, 2, '0');
+                    cached_text[19] = 0;
+                    cached_time = time;
+                }
+
+                return cached_text;
+            }
+        };
+
+        //////////////////////////////////////////////////////////////////////////
+        // Pattern fields
+
+        template<char c>
+        struct Char
+        {
+            static void write(Cursor& out, const Record&)
+            {
+                out.put(util::nchar(c));
+            }
+        };
+
+        struct Date
+        {
+            static void write(Cursor& out, const Record& record)
+            {
+                const util::nchar* text = DateTimeCache::get(record.getTime().time);
+                for (int i = 0; i < 10; ++i)
+                    out.put(text[i]);
+            }
+        };
+
+        struct Time
+        {
+            static void write(Cursor& out, const Record& record)
+            {
+                out.putNative(DateTimeCache::get(record.getTime().time) + 11);
+            }
+        };
+
+        struct Millis
+        {
+            static void write(Cursor& out, const Record& record)
+            {
+                out.putDec(record.getTime().millitm, 3, '0');
+            }
+        };
+
+        // monotonic clock as seconds.nanoseconds
+        struct MonotonicTime
+        {
+            static void write(Cursor& out, const Record& record)
+            {
+                unsigned long long nanos = record.getMonotonicNanos();
+                out.putDec(nanos / 1000000000ULL, 0, ' ');
+                out.put('.');
+                out.putDec(nanos % 1000000000ULL, 9, '0');
+            }
+        };
+
+        // sample position of the current block, '-' outside audio processing
+        struct SamplePos
+        {
+            static void write(Cursor& out, const Record& record)
+            {
+                const BlockPosition& position = record.getBlockPosition();
+                if (position.valid)
+                    out.putFixed(position.samplePos, 0);
+                else
+                    out.put('-');
+            }
+        };
+
+        struct PpqPos
+        {
+            static void write(Cursor& out, const Record& record)
+            {
+                const BlockPosition& position = record.getBlockPosition();
+                if (position.valid)
+                    out.putFixed(position.ppqPos, 6);
+                else
+                    out.put('-');
+            }
+        };
+
+        struct Level
+        {
+            static void write(Cursor& out, const Record& record)
+            {
+                const char* str = severityToString(record.getSeverity());
+                int len = 0;
+                for (; str[len]; ++len)
+                    out.put(util::nchar(str[len]));
+                for (; len < 5; ++len)
+                    out.put(' ');
+            }
+        };
+
+        struct Tid
+        {
+            static void write(Cursor& out, const Record& record)
+            {
+                out.putDec(record.getTid(), 0, ' ');
+            }
+        };
+
+        struct Func
+        {
+            static void write(Cursor& out, const Record& record)
+            {
+                out.putAscii(record.getFunc());
+            }
+        };
+
+        struct Line
+        {
+            static void write(Cursor& out, const Record& record)
+            {
+                out.putDec(record.getLine(), 0, ' ');
+            }
+        };
+
+        struct Message
+        {
+            static void write(Cursor& out, const Record& record)
+            {
+                out.putNative(record.getMessage());
+            }
+        };
+    }
+
+    // Formatter composed from pattern fields at compile time.
+    // format(record, buf, size) writes into the caller's buffer without allocating;
+    // format(record) is kept for appenders that take a string.
+    template<class... Fields>
+    class PatternFormatter
+    {
+    public:
+        static util::nstring header()
+        {
+            return util::nstring();
+        }
+
+        static size_t format(const Record& record, util::nchar* buf, size_t size)
+        {
+            pattern::Cursor out = { buf, buf + size };
+            int expand[] = { 0, (Fields::write(out, record), 0)... };
+            (void)expand;
+
+            // keep the record terminated when it was truncated
+            if (out.pos == out.end && size > 0)
+                buf[size - 1] = '\n';
+
+            return out.pos - buf;
+        }
+
+        static util::nstring format(const Record& record)
+        {
+            util::nchar buf[kMaxRecordLength];
+            return util::nstring(buf, format(record, buf, kMaxRecordLength));
+        }
+    };
+}
@@ -1,35 +1,237 @@
 #pragma once
 
+// 1: write debug log in binary format (decode with tools/logdecode)
+#define kBinaryDebugLog 0
+
+// the binary log takes the numbers of a message as typed arguments where it is logged
+#define PLOG_CAPTURE_ARGS kBinaryDebugLog
+
 #include <plog/Log.h>
+#include <atomic>
+#include <cstdlib>
+#include "asyncappender.h"
+#include "binaryappender.h"
+#include "bufferedappender.h"
+#include "logformat.h"
+#include "lograte.h"
+
+// 1: text debug log also shows monotonic time and the sample and ppq position of the block
+#define kTimingDebugLog 0
+
+// debug log moves on to a new file at this size, keeping ntpcs.debug.1 to .3 as the older ones
+#define kDebugLogMaxFileSize (16 * 1024 * 1024)
+#define kDebugLogMaxFiles 4
+
+// Most verbose severity compiled in. Call sites above it are removed together
+// with their arguments. Define NTPCS_LOG_MAX_SEVERITY=plog::none to strip all logging.
+#ifndef NTPCS_LOG_MAX_SEVERITY
+#if _DEBUG
+#define NTPCS_LOG_MAX_SEVERITY plog::verbose
+#else
+#define NTPCS_LOG_MAX_SEVERITY plog::debug
+#endif
+#endif
+
+// Log categories, enabled at runtime by the NTPCS_LOG environment variable
+// ("clock,transport", "all" or a bitmask). Debug builds enable all by default.
+enum LogCategory
+{
+    kLogEvents = 1 << 0,        // incoming MIDI events
+    kLogTransport = 1 << 1,     // host transport and start/stop
+    kLogClock = 1 << 2,         // timing clock generation
+    kLogTransmitter = 1 << 3,   // output queues and sent events
+    kLogBudget = 1 << 4,        // blocks over the CPU budget
+    kLogAll = 0xffff,
+};
+
+// Costs one relaxed atomic load per call site when the category is disabled.
+// Enabled call sites are rate limited each on its own (NTPCS_LOG_RATE records
+// per second, 0 for no limit), the next record after a second with dropped
+// records is preceded by a summary of how many were suppressed. An enabled
+// call site does not allocate or lock as long as it streams strings and
+// numbers, so categories can stay on in the audio thread (replay -rt -log).
+#define LOG_CAT(category, severity) \
+    if (!((severity) <= NTPCS_LOG_MAX_SEVERITY && (plog::getLogCategories() & (category)) != 0)) {;} \
+    else if (!plog::passLogRateLimit(NTPCS_LOG_RATE_LIMITER(), severity, PLOG_GET_FUNC(), __LINE__, PLOG_GET_FILE(), PLOG_GET_THIS())) {;} \
+    else LOG(severity)
+
+#define LOGV_CAT(category)  LOG_CAT(category, plog::verbose)
+#define LOGD_CAT(category)  LOG_CAT(category, plog::debug)
+#define LOGI_CAT(category)  LOG_CAT(category, plog::info)
+#define LOGW_CAT(category)  LOG_CAT(category, plog::warning)
+#define LOGE_CAT(category)  LOG_CAT(category, plog::error)
 
 namespace plog
 {
-    class NtpcsLogFormatter
+    // 2017-01-01 12:34:56.789 DEBUG [Ntpcs::processEvents] message
+    typedef PatternFormatter<
+        pattern::Date, pattern::Char<' '>, pattern::Time, pattern::Char<'.'>, pattern::Millis, pattern::Char<' '>,
+        pattern::Level, pattern::Char<' '>,
+        pattern::Char<'['>, pattern::Func, pattern::Char<']'>, pattern::Char<' '>,
+        pattern::Message, pattern::Char<'\n'>
+    > NtpcsLogFormatter;
+
+    // 2017-01-01 12:34:56.789 1234.567890123 DEBUG [44100 1.000000] [Ntpcs::processEvents] message
+    typedef PatternFormatter<
+        pattern::Date, pattern::Char<' '>, pattern::Time, pattern::Char<'.'>, pattern::Millis, pattern::Char<' '>,
+        pattern::MonotonicTime, pattern::Char<' '>,
+        pattern::Level, pattern::Char<' '>,
+        pattern::Char<'['>, pattern::SamplePos, pattern::Char<' '>, pattern::PpqPos, pattern::Char<']'>, pattern::Char<' '>,
+        pattern::Char<'['>, pattern::Func, pattern::Char<']'>, pattern::Char<' '>,
+        pattern::Message, pattern::Char<'\n'>
+    > NtpcsTimingLogFormatter;
+
+#if kTimingDebugLog
+    typedef NtpcsTimingLogFormatter NtpcsDebugLogFormatter;
+#else
+    typedef NtpcsLogFormatter NtpcsDebugLogFormatter;
+#endif
+
+    namespace detail
     {
-    public:
-        static util::nstring header()
+        inline std::atomic<unsigned int>& logCategories()
         {
-            return util::nstring();
+            static std::atomic<unsigned int> categories(0);
+            return categories;
+        }
+
+        inline unsigned int parseLogCategories(const char* text)
+        {
+            char* end;
+            unsigned long mask = std::strtoul(text, &end, 0);
+            if (end != text && *end == 0)
+                return static_cast<unsigned int>(mask);
+
+            static const struct { const char* name; unsigned int mask; } kNames[] = {
+                { "events", kLogEvents },
+                { "transport", kLogTransport },
+                { "clock", kLogClock },
+                { "transmitter", kLogTransmitter },
+                { "budget", kLogBudget },
+                { "all", kLogAll },
+            };
+
+            unsigned int categories = 0;
+            for (const char* token = text; *token; )
+            {
+                size_t length = std::strcspn(token, ",");
+                for (size_t i = 0; i < sizeof(kNames) / sizeof(kNames[0]); ++i)
+                {
+                    if (std::strlen(kNames[i].name) == length && std::strncmp(kNames[i].name, token, length) == 0)
+                        categories |= kNames[i].mask;
+                }
+                token += length;
+                if (*token == ',')
+                    ++token;
+            }
+            return categories;
         }
 
-        static util::nstring format(const Record& record)
+        class NtpcsLog
         {
-            tm t;
-            util::localtime_s(&t, &record.getTime().time);
+        public:
+            NtpcsLog()
+#if kBinaryDebugLog
+                : m_fileAppender("ntpcs.debug.nlog", kDebugLogMaxFileSize, kDebugLogMaxFiles)
+#else
+                : m_fileAppender("ntpcs.debug.log", kDebugLogMaxFileSize, kDebugLogMaxFiles)
+#endif
+                , m_asyncAppender(4096, dropOldest)
+            {
+                m_asyncAppender.addAppender(&m_fileAppender);
+                init(NTPCS_LOG_MAX_SEVERITY, &m_asyncAppender);
+            }
+
+            void start()
+            {
+                m_fileAppender.start();
+                m_asyncAppender.start();
+            }
+
+            void stop()
+            {
+                m_asyncAppender.stop();
+                m_fileAppender.stop();
+            }
 
-            util::nstringstream ss;
-            ss << t.tm_year + 1900 << "-"
-                << std::setfill(PLOG_NSTR('0')) << std::setw(2) << t.tm_mon + 1 << PLOG_NSTR("-")
-                << std::setfill(PLOG_NSTR('0')) << std::setw(2) << t.tm_mday << PLOG_NSTR(" ");
-            ss << std::setfill(PLOG_NSTR('0')) << std::setw(2) << t.tm_hour << PLOG_NSTR(":")
-                << std::setfill(PLOG_NSTR('0')) << std::setw(2) << t.tm_min << PLOG_NSTR(":")
-                << std::setfill(PLOG_NSTR('0')) << std::setw(2) << t.tm_sec << PLOG_NSTR(".")
-                << std::setfill(PLOG_NSTR('0')) << std::setw(3) << record.getTime().millitm << PLOG_NSTR(" ");
-            ss << std::setfill(PLOG_NSTR(' ')) << std::setw(5) << std::left << severityToString(record.getSeverity()) << PLOG_NSTR(" ");
-            ss << PLOG_NSTR("[") << record.getFunc() << PLOG_NSTR("] ");
-            ss << record.getMessage() << PLOG_NSTR("\n");
+        private:
+#if kBinaryDebugLog
+            BinaryFileAppender m_fileAppender;
+#else
+            BufferedFileAppender<NtpcsDebugLogFormatter> m_fileAppender;
+#endif
+            AsyncAppender m_asyncAppender;
+        };
 
-            return ss.str();
+        inline NtpcsLog& ntpcsLog()
+        {
+            static NtpcsLog log;
+            return log;
+        }
+
+        inline util::Mutex& ntpcsLogMutex()
+        {
+            static util::Mutex mutex;
+            return mutex;
+        }
+
+        inline int& ntpcsLogUsers()
+        {
+            static int users = 0;
+            return users;
+        }
+
+        inline bool& ntpcsLogStarted()
+        {
+            static bool started = false;
+            return started;
+        }
+    }
+
+    inline unsigned int getLogCategories()
+    {
+        return detail::logCategories().load(std::memory_order_relaxed);
+    }
+
+    // Categories can be narrowed at any time, widening them only has an effect
+    // if the log was started with at least one category enabled.
+    inline void setLogCategories(unsigned int categories)
+    {
+        detail::logCategories().store(categories, std::memory_order_relaxed);
+    }
+
+    // Debug log is shared by all plugin instances of the process. It is started by the
+    // first instance if any category is enabled, and its threads are joined by the last
+    // instance to close.
+    inline void openNtpcsLog()
+    {
+        util::MutexLock lock(detail::ntpcsLogMutex());
+        if (detail::ntpcsLogUsers()++ == 0)
+        {
+            const char* env = std::getenv("NTPCS_LOG");
+#if _DEBUG
+            setLogCategories(env ? detail::parseLogCategories(env) : static_cast<unsigned int>(kLogAll));
+#else
+            setLogCategories(env ? detail::parseLogCategories(env) : 0);
+#endif
+            const char* rate = std::getenv("NTPCS_LOG_RATE");
+            setLogRate(rate ? static_cast<unsigned int>(std::strtoul(rate, NULL, 0)) : kLogRateDefault);
+            if (getLogCategories() != 0 && NTPCS_LOG_MAX_SEVERITY != none)
+            {
+                detail::ntpcsLog().start();
+                detail::ntpcsLogStarted() = true;
+            }
+        }
+    }
+
+    inline void closeNtpcsLog()
+    {
+        util::MutexLock lock(detail::ntpcsLogMutex());
+        if (--detail::ntpcsLogUsers() == 0 && detail::ntpcsLogStarted())
+        {
+            LogRateLimiter::flushSummaries();
+            detail::ntpcsLog().stop();
+            detail::ntpcsLogStarted() = false;
         }
-    };
+    }
 }
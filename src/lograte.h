@@ -0,0 +1,170 @@
+#pragma once
+
+#include <plog/Logger.h>
+#include <plog/Util.h>
+#include <atomic>
+
+#define kLogRateDefault 10                      // records per second and call site, 0: unlimited
+#define kLogRateWindowNanos 1000000000ULL       // suppressed records are summed up per window
+
+namespace plog
+{
+    class LogRateLimiter;
+
+    namespace detail
+    {
+        inline std::atomic<unsigned int>& logRate()
+        {
+            static std::atomic<unsigned int> rate(kLogRateDefault);
+            return rate;
+        }
+
+        // limiters that suppressed records, so closing the log can report the last window
+        inline std::atomic<LogRateLimiter*>& logRateLimiters()
+        {
+            static std::atomic<LogRateLimiter*> first(NULL);
+            return first;
+        }
+    }
+
+    inline unsigned int getLogRate()
+    {
+        return detail::logRate().load(std::memory_order_relaxed);
+    }
+
+    inline void setLogRate(unsigned int rate)
+    {
+        detail::logRate().store(rate, std::memory_order_relaxed);
+    }
+
+    // Token bucket of one log call site, holding one second of records at the
+    // current rate. It is kept as the time the bucket is full again (GCRA), so a
+    // record costs a clock read and one compare-exchange, and the limiter
+    // needs no initialization beyond zeros. Call sites shared by instances on
+    // several threads stay consistent. Records still suppressed when the log
+    // closes are reported then.
+    class LogRateLimiter
+    {
+    public:
+        constexpr LogRateLimiter()
+            : m_fullNanos(0)
+            , m_windowEndNanos(0)
+            , m_suppressed(0)
+            , m_listed(false)
+            , m_next(NULL)
+            , m_severity(none)
+            , m_func("")
+            , m_line(0)
+            , m_file("")
+        {
+        }
+
+        // suppressed receives the records dropped in the window that closed with
+        // this call, 0 if it did not close one
+        bool allow(unsigned long long now, unsigned int& suppressed)
+        {
+            suppressed = 0;
+            unsigned int rate = getLogRate();
+            if (rate == 0)
+            {
+                return true;
+            }
+
+            unsigned long long windowEnd = m_windowEndNanos.load(std::memory_order_relaxed);
+            if (now >= windowEnd && m_windowEndNanos.compare_exchange_strong(windowEnd, now + kLogRateWindowNanos, std::memory_order_relaxed))
+            {
+                suppressed = m_suppressed.exchange(0, std::memory_order_relaxed);
+            }
+
+            unsigned long long interval = kLogRateWindowNanos / rate;
+            unsigned long long full = m_fullNanos.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                unsigned long long start = full > now ? full : now;
+                if (start + interval - now > kLogRateWindowNanos)
+                {
+                    m_suppressed.fetch_add(1, std::memory_order_relaxed);
+                    return false;   // bucket is empty
+                }
+                if (m_fullNanos.compare_exchange_weak(full, start + interval, std::memory_order_relaxed))
+                {
+                    return true;
+                }
+            }
+        }
+
+        // Adds the limiter to the list closing the log reports, once. Lock-free and
+        // without allocation, the call site is kept for the summary.
+        void list(Severity severity, const char* func, size_t line, const char* file)
+        {
+            if (m_listed.load(std::memory_order_relaxed) || m_listed.exchange(true, std::memory_order_relaxed))
+            {
+                return;
+            }
+
+            m_severity = severity;
+            m_func = func;
+            m_line = line;
+            m_file = file;
+            std::atomic<LogRateLimiter*>& first = detail::logRateLimiters();
+            m_next = first.load(std::memory_order_relaxed);
+            while (!first.compare_exchange_weak(m_next, this, std::memory_order_release, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        // Logs the records suppressed in the current windows of all listed limiters
+        static void flushSummaries()
+        {
+            for (LogRateLimiter* limiter = detail::logRateLimiters().load(std::memory_order_acquire); limiter; limiter = limiter->m_next)
+            {
+                unsigned int suppressed = limiter->m_suppressed.exchange(0, std::memory_order_relaxed);
+                if (suppressed != 0)
+                {
+                    logSummary(limiter->m_severity, limiter->m_func, limiter->m_line, limiter->m_file, NULL, suppressed);
+                }
+            }
+        }
+
+        static void logSummary(Severity severity, const char* func, size_t line, const char* file, const void* object, unsigned int suppressed)
+        {
+            Logger<PLOG_DEFAULT_INSTANCE>* logger = get<PLOG_DEFAULT_INSTANCE>();
+            if (logger && logger->checkSeverity(severity))
+            {
+                (*logger) += Record(severity, func, line, file, object) << suppressed << " similar messages suppressed";
+            }
+        }
+
+    private:
+        std::atomic<unsigned long long> m_fullNanos;
+        std::atomic<unsigned long long> m_windowEndNanos;
+        std::atomic<unsigned int> m_suppressed;
+        std::atomic<bool> m_listed;
+        LogRateLimiter* m_next;
+        Severity m_severity;
+        const char* m_func;
+        size_t m_line;
+        const char* m_file;
+    };
+
+    // Takes a token for a record of the call site, first logging a summary of
+    // the records it suppressed when a window closed
+    inline bool passLogRateLimit(LogRateLimiter& limiter, Severity severity, const char* func, size_t line, const char* file, const void* object)
+    {
+        unsigned int suppressed;
+        bool pass = limiter.allow(util::monotonicNanos(), suppressed);
+        if (suppressed != 0)
+        {
+            LogRateLimiter::logSummary(severity, func, line, file, object, suppressed);
+        }
+        if (!pass)
+        {
+            limiter.list(severity, func, line, file);
+        }
+        return pass;
+    }
+}
+
+// Limiter of the call site it is expanded at, each lambda has its own static
+#define NTPCS_LOG_RATE_LIMITER() \
+    ([]() -> plog::LogRateLimiter& { static plog::LogRateLimiter limiter; return limiter; }())
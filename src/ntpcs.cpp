@@ -9,117 +9,356 @@ Ntpcs::Ntpcs(audioMasterCallback audio_master)
     : AudioEffectX(audio_master, kNumPrograms, kNumParams)
     , last_note_on_(0)
     , polyphony_(0)
-    , prev_remainder_sample_frames_(0)
-    , sent_first_clock_(false)
+    , clock_port_(kPortA)
+    , sysex_port_(kPortB)
+    , midi_thru_(kMidiThruMode == 1)
+    , thru_port_(kPortB)
+    , capture_(NULL)
+    , opened_(false)
+    , state_restored_(false)
+    , pending_state_(NULL)
 {
-#if _DEBUG
-    plog::init<plog::NtpcsLogFormatter>(plog::debug, "ntpcs.debug.log");
-    LOGD << "init";
-#endif
+    // hosts create instances just to scan or load them, everything that costs
+    // more than the object itself waits for resume()
+    clock_generator_.setOutputs((kMidiClockTransmitterMode == 1 ? kClockOutputMidiClock : 0) | (kSyncPulseOutputs & ~kClockOutputMidiClock));
     setNumInputs(0);
     setNumOutputs(2);
     setUniqueID(CCONST('n', 't', 'p', 'c'));
     canProcessReplacing(true);
     isSynth(false);
+    programsAreChunks(true);
 
-    transmitter = new EventTransmitter(this);
+    // NOTE: Enable GUI operation in the future
+    for (int ch = 0; ch < 16; ++ch)
+    {
+        program_change_port_[ch] = kPortB;
+    }
+
+    transmitter = NULL;
 }
 
+// The capture, trace and log threads are joined here and not left to static
+// destructors: those run under the loader lock when the host unloads the DLL,
+// and a thread that is joined there can never exit.
 Ntpcs::~Ntpcs()
 {
-#if _DEBUG
-    LOGD << "close";
-#endif
+    delete capture_;
+    delete transmitter;
+    delete pending_state_.load();
+    if (!opened_)
+    {
+        return;
+    }
+
+    BudgetStats budget = budget_monitor_.getStats();
+    LOGI_CAT(kLogBudget) << "CPU budget: blocks " << budget.blocks
+        << " overruns " << budget.overruns
+        << " worst " << budget.worst
+        << " p50 " << budget.p50
+        << " p95 " << budget.p95
+        << " p99 " << budget.p99;
+    LOGI_CAT(kLogTransmitter) << "Program changes delayed " << program_change_limiter_.getDelayedCount()
+        << " coalesced " << program_change_limiter_.getCoalescedCount();
+    LOGD_CAT(kLogEvents) << "close";
+    tracer::close();
+    plog::closeNtpcsLog();
+}
+
+void Ntpcs::resume()
+{
+    if (!opened_)
+    {
+        opened_ = true;
+        plog::openNtpcsLog();
+        tracer::open();
+        capture_ = SessionCapture::createFromEnvironment();
+        LOGD_CAT(kLogEvents) << "init";
+
+        // a restored project keeps its own settings
+        if (!state_restored_)
+        {
+            zone_map_.loadFromEnvironment();
+            program_change_limiter_.loadFromEnvironment();
+        }
+        telemetry_.open();
+    }
+    memset(&telemetry_stats_, 0, sizeof(telemetry_stats_));
+
+    // allocate here, sized for the host's block size and sample rate, the audio
+    // thread only takes events and buffers from what exists
+    if (!transmitter)
+    {
+        transmitter = new EventTransmitter(this, EventTransmitter::getEventCapacity(getBlockSize(), getSampleRate()));
+    }
+    transmitter->getSysexPool().reserve();
+    zone_map_.reserve();
+    BudgetMonitor::getCyclesPerSecond();    // calibrates once, rather than on the audio thread
+    program_change_limiter_.setSampleRate(getSampleRate());
+    AudioEffectX::resume();
+}
+
+void Ntpcs::suspend()
+{
+    AudioEffectX::suspend();
+
+    // the host has consumed every block, including SysEx still referenced
     delete transmitter;
+    transmitter = NULL;
+}
+
+VstInt32 Ntpcs::getChunk(void** data, bool is_preset)
+{
+    // after setChunk the audio thread may be applying the state to the members
+    NtpcsState state;
+    if (state_restored_)
+    {
+        state = restored_state_;
+    }
+    else
+    {
+        state.midi_thru = midi_thru_;
+        state.clock_port = clock_port_;
+        state.sysex_port = sysex_port_;
+        state.thru_port = thru_port_;
+        for (int ch = 0; ch < 16; ++ch)
+        {
+            state.program_change_port[ch] = program_change_port_[ch];
+            state.program_change_interval[ch] = program_change_limiter_.getMinInterval(ch);
+        }
+        state.clock_outputs = clock_generator_.getOutputs();
+    }
+    state.zone_rules = zone_map_.getRules();
+
+    writeState(state, chunk_);
+    *data = &chunk_[0];
+    return (VstInt32)chunk_.size();
+}
+
+VstInt32 Ntpcs::setChunk(void* data, VstInt32 byte_size, bool is_preset)
+{
+    NtpcsState state;
+    if (!readState(data, byte_size, state))
+    {
+        LOGW_CAT(kLogEvents) << "Ignored state chunk of " << byte_size << " bytes";
+        return 0;
+    }
+
+    // hosts may restore state while the plugin runs, so like the zones the
+    // options are published and the audio thread applies them between blocks
+    PendingState* pending = new PendingState;
+    pending->state = state;
+    pending->next_retired = NULL;
+    delete pending_state_.exchange(pending);
+    retired_states_.clear();
+    zone_map_.setRules(state.zone_rules);
+    restored_state_ = state;
+    state_restored_ = true;
+    return 1;
+}
+
+// audio thread: applies the state of the last setChunk, if there is a new one
+void Ntpcs::applyPendingState()
+{
+    if (pending_state_.load(std::memory_order_relaxed) == NULL)
+    {
+        return;
+    }
+    PendingState* pending = pending_state_.exchange(NULL);
+    if (!pending)
+    {
+        return;
+    }
+
+    const NtpcsState& state = pending->state;
+    midi_thru_ = state.midi_thru;
+    if (state.clock_port < kNumOutputPorts)
+        clock_port_ = state.clock_port;
+    if (state.sysex_port < kNumOutputPorts)
+        sysex_port_ = state.sysex_port;
+    if (state.thru_port < kNumOutputPorts)
+        thru_port_ = state.thru_port;
+    for (int ch = 0; ch < 16; ++ch)
+    {
+        if (state.program_change_port[ch] < kNumOutputPorts)
+            program_change_port_[ch] = state.program_change_port[ch];
+        program_change_limiter_.setMinInterval(ch, state.program_change_interval[ch]);
+    }
+    clock_generator_.setOutputs(state.clock_outputs);
+    retired_states_.push(pending);
 }
 
 VstInt32 Ntpcs::processEvents(VstEvents* events)
 {
-    for (int i = 0; i < events->numEvents; ++i)
+    if (!transmitter)
+    {
+        return 0;   // suspended
+    }
+
+    unsigned long long budget_begin = budget_monitor_.begin();
+    TraceScope trace("processEvents", this);
+    if (capture_)
+    {
+        capture_->captureEvents(events);
+    }
+    trace.setEventCount(events->numEvents);
+    telemetry_stats_.input_events += events->numEvents;
+    zone_map_.update();
+    applyPendingState();
+    VstInt32 queued_events = transmitter->getQueuedEventCount();
+
+    // without thru only note on and note off matter, the batch lists them
+    // without visiting the rest again
+    for (VstInt32 first = 0; first < events->numEvents; first += kEventBatchSize)
     {
-        if (events->events[i]->type == kVstMidiType)
+        input_batch_.gather(events, first);
+        input_batch_.classify();
+        LOGV_CAT(kLogEvents) << "Batch of " << input_batch_.getCount() << " events: "
+            << input_batch_.getNoteEventCount() << " notes, "
+            << input_batch_.getRealtimeEventCount() << " realtime";
+
+        if (midi_thru_)
         {
-            VstMidiEvent* inEv = (VstMidiEvent*)(events->events[i]);
-#if _DEBUG
-            LOGD << "Input MIDI msg: "
-                << int(inEv->midiData[0]) << " "
-                << int(inEv->midiData[1]) << " "
-                << int(inEv->midiData[2]) << " "
-                << int(inEv->midiData[3]);
-            LOGD << "   deltaFrames: " << inEv->deltaFrames;
-#endif
-            // Receive NOTE OFF message (accept all channels)
-            if (kNoteOff <= int(inEv->midiData[0]) && int(inEv->midiData[0]) <= kNoteOff + 0x0f)
+            // every event in input order, generated events go right before the note that caused them
+            for (VstInt32 i = 0; i < input_batch_.getCount(); ++i)
             {
-#if _DEBUG
-                LOGD << "Received NOTE OFF";
-#endif
-                if (transmitter->getEventCount() < kMaxEvents)
+                unsigned char status = input_batch_.getStatus(i);
+                unsigned char kind = status & 0xF0;
+                if (kind == (unsigned char)kNoteOff || kind == (unsigned char)kNoteOn)
                 {
-                    if (polyphony_ == 1)
-                    {
-                        if (kMidiClockTransmitterMode == 1)
-                        {
-                            // STOP message
-                            char midi_data_stop[4] = { kStop, 0, 0, 0 };
-                            VstMidiEvent* evStop = transmitter->addMidiEvent(inEv->deltaFrames, 0, midi_data_stop);
-#if _DEBUG
-                            LOGD << "<< SEND MIDI EVENT: STOP >> "
-                                << "deltaFrames: " << evStop->deltaFrames;
-#endif
-                        }
-                    }
-
-                    if (polyphony_ > 0)
-                        --polyphony_;
+                    processNoteEvent(status, input_batch_.getData1(i), input_batch_.getData2(i), input_batch_.getDeltaFrames(i));
                 }
+                if (status != 0 && status != 0xF0)
+                {
+                    char midi_data_thru[4] = { (char)status, (char)input_batch_.getData1(i), (char)input_batch_.getData2(i), 0 };
+                    transmitter->addMidiEvent(thru_port_, input_batch_.getDeltaFrames(i), midi_data_thru);
+                }
+            }
+        }
+        else
+        {
+            for (VstInt32 n = 0; n < input_batch_.getNoteEventCount(); ++n)
+            {
+                VstInt32 i = input_batch_.getNoteEvent(n);
+                processNoteEvent(input_batch_.getStatus(i), input_batch_.getData1(i), input_batch_.getData2(i), input_batch_.getDeltaFrames(i));
             }
-            // Received NOTE ON message (accept all channels)
-            else if (kNoteOn <= int(inEv->midiData[0]) && int(inEv->midiData[0]) <= kNoteOn + 0x0f)
+        }
+
+        // forward SysEx (patch dumps, device commands) as they are
+        for (VstInt32 n = 0; n < input_batch_.getSysexEventCount(); ++n)
+        {
+            VstMidiSysexEvent* inSysex = (VstMidiSysexEvent*)events->events[first + input_batch_.getSysexEvent(n)];
+            VstMidiSysexEvent* evSysex = transmitter->addSysexEvent(sysex_port_, inSysex->deltaFrames, inSysex->sysexDump, inSysex->dumpBytes);
+            LOGD_CAT(kLogTransmitter) << "<< SEND MIDI EVENT: SYSEX >> "
+                << "port: " << sysex_port_ << " "
+                << "bytes: " << inSysex->dumpBytes << " "
+                << "deltaFrames: " << (evSysex ? evSysex->deltaFrames : -1);
+        }
+    }
+
+    trace.setEmittedEvents(transmitter->getQueuedEventCount() - queued_events);
+    budget_monitor_.end(budget_begin);
+    return 1;
+}
+
+// Generates program change, start and stop for one note on or note off
+void Ntpcs::processNoteEvent(unsigned char status, unsigned char data1, unsigned char data2, VstInt32 delta_frames)
+{
+    LOGD_CAT(kLogEvents) << "Input MIDI msg: "
+        << int(status) << " "
+        << int(data1) << " "
+        << int(data2);
+    LOGD_CAT(kLogEvents) << "   deltaFrames: " << delta_frames;
+    // Receive NOTE OFF message (accept all channels)
+    if ((status & 0xF0) == (unsigned char)kNoteOff)
+    {
+        LOGD_CAT(kLogEvents) << "Received NOTE OFF";
+        if (transmitter->getFreeEventCount(clock_port_) > 0)
+        {
+            if (polyphony_ == 1)
             {
-#if _DEBUG
-                LOGD << "Received NOTE ON";
-#endif
-                if (transmitter->getEventCount() < kMaxEvents - 1)    // set two messages
+                if (kMidiClockTransmitterMode == 1)
                 {
-                    // PROGRAM CHANGE message
-                    char channel = inEv->midiData[0] - kNoteOn;
-#if _DEBUG
-                    LOGD << "Received channel: " << int(channel);
-#endif
-                    char midi_data_prg_chg[4] = { kProgramChange + channel, inEv->midiData[1], 0, 0 };
-                    VstMidiEvent* evPrgChg = transmitter->addMidiEvent(inEv->deltaFrames, 0, midi_data_prg_chg);
-#if _DEBUG
-                    LOGD << "<< SEND MIDI EVENT: PROGRAM CHANGE >> "
-                        << "deltaFrames: " << evPrgChg->deltaFrames;
-#endif
-
-                    if (polyphony_ == 0)
-                    {
-                        if (kMidiClockTransmitterMode == 1)
-                        {
-                            // START message
-                            char midi_data_start[4] = { kStart, 0, 0, 0 };
-                            VstMidiEvent* evStart = transmitter->addMidiEvent(inEv->deltaFrames, 0, midi_data_start);
-#if _DEBUG
-                            LOGD << "<< SEND MIDI EVENT: START >> "
-                                << "deltaFrames: " << evStart->deltaFrames;
-#endif
-                        }
-                    }
+                    // STOP message
+                    char midi_data_stop[4] = { kStop, 0, 0, 0 };
+                    bool sentStop = transmitter->addMidiEvent(clock_port_, delta_frames, midi_data_stop);
+                    LOGD_CAT(kLogTransport) << "<< SEND MIDI EVENT: STOP >> "
+                        << "port: " << clock_port_ << " "
+                        << "deltaFrames: " << (sentStop ? delta_frames : -1);
+                }
+            }
+
+            if (polyphony_ > 0)
+                --polyphony_;
+        }
+    }
+    // Received NOTE ON message (accept all channels)
+    else
+    {
+        LOGD_CAT(kLogEvents) << "Received NOTE ON";
+        char channel = status & 0x0F;
+        VstInt32 port = program_change_port_[int(channel)];
+        const ZoneTarget& target = zone_map_.lookup(status, data1, data2);
+        VstInt32 needed_events = target.bank_msb == kZoneNoBank ? 1 : 3;
+        // room for the program change with its bank select, and for a start on the clock port
+        if (transmitter->getFreeEventCount(port) >= needed_events &&
+            transmitter->getFreeEventCount(clock_port_) > 0)
+        {
+            LOGD_CAT(kLogEvents) << "Received channel: " << int(channel);
+            if (program_change_limiter_.request(port, target, delta_frames))
+            {
+                sendProgramChange(port, target, delta_frames);
+            }
+            else
+            {
+                LOGD_CAT(kLogTransmitter) << "PROGRAM CHANGE held back, channel: " << int(target.channel);
+            }
 
-                    last_note_on_ = inEv->midiData[1];
-                    ++polyphony_;
+            if (polyphony_ == 0)
+            {
+                if (kMidiClockTransmitterMode == 1)
+                {
+                    // START message
+                    char midi_data_start[4] = { kStart, 0, 0, 0 };
+                    bool sentStart = transmitter->addMidiEvent(clock_port_, delta_frames, midi_data_start);
+                    LOGD_CAT(kLogTransport) << "<< SEND MIDI EVENT: START >> "
+                        << "port: " << clock_port_ << " "
+                        << "deltaFrames: " << (sentStart ? delta_frames : -1);
                 }
             }
+
+            last_note_on_ = (char)data1;
+            ++polyphony_;
         }
     }
+}
 
-    return 1;
+void Ntpcs::sendProgramChange(VstInt32 port, const ZoneTarget& target, VstInt32 delta_frames)
+{
+    char out_channel = (char)target.channel;
+    if (target.bank_msb != kZoneNoBank)
+    {
+        // BANK SELECT messages, MSB then LSB
+        char midi_data_bank_msb[4] = { (char)(kControlChange + out_channel), 0x00, (char)target.bank_msb, 0 };
+        char midi_data_bank_lsb[4] = { (char)(kControlChange + out_channel), 0x20, (char)target.bank_lsb, 0 };
+        transmitter->addMidiEvent(port, delta_frames, midi_data_bank_msb);
+        transmitter->addMidiEvent(port, delta_frames, midi_data_bank_lsb);
+    }
+
+    // PROGRAM CHANGE message
+    char midi_data_prg_chg[4] = { (char)(kProgramChange + out_channel), (char)target.program, 0, 0 };
+    bool sentPrgChg = transmitter->addMidiEvent(port, delta_frames, midi_data_prg_chg);
+    if (sentPrgChg)
+        ++telemetry_stats_.program_changes_sent;
+    LOGD_CAT(kLogTransmitter) << "<< SEND MIDI EVENT: PROGRAM CHANGE >> "
+        << "port: " << port << " "
+        << "deltaFrames: " << (sentPrgChg ? delta_frames : -1);
 }
 
 void Ntpcs::processReplacing(float** inputs, float** outputs, VstInt32 sample_frames)
 {
+    unsigned long long budget_begin = budget_monitor_.begin();
+    TraceScope trace("processReplacing", this);
+
     // dummy
     float *out1 = outputs[0];
     float *out2 = outputs[1];
@@ -129,6 +368,13 @@ void Ntpcs::processReplacing(float** inputs, float** outputs, VstInt32 sample_fr
         (*out2++) = 0.0f;
     }
 
+    if (!transmitter)
+    {
+        return;     // suspended
+    }
+    applyPendingState();
+    VstInt32 queued_events = transmitter->getQueuedEventCount();
+
     VstTimeInfo* time_info = getTimeInfo(
         kVstTransportPlaying |
         kVstTransportCycleActive |
@@ -141,64 +387,109 @@ void Ntpcs::processReplacing(float** inputs, float** outputs, VstInt32 sample_fr
         0
     );
 
-#if _DEBUG
-    LOGD << "      ppqPos: " << time_info->ppqPos;
-    LOGD << "sampleFrames: " << sample_frames;
-#endif
-
-    if (kMidiClockTransmitterMode == 1)
+    if (capture_)
     {
-        // send timing clock
-        double current_sample_cursor = 0.0;
-        double tempo = time_info->tempo;
-        double sample_rate = time_info->sampleRate;
-        double clocks_per_second = tempo * 24.0 / 60.0;
-        double samples_per_clock = sample_rate * (1.0 / clocks_per_second);
+        capture_->captureBlock(sample_frames, getSampleRate(), time_info);
+    }
 
-        if (!sent_first_clock_)
-        {
-            char midi_data_first[4] = { kClock, 0, 0, 0 };
-            VstMidiEvent* ev = transmitter->addMidiEvent(0, 0, midi_data_first);
-#if _DEBUG
-            LOGD << "<< SEND MIDI EVENT: CLOCK >> "
-                << "deltaFrames: " << ev->deltaFrames;
-#endif
-            sent_first_clock_ = true;
-        }
+    // hosts without transport return no time info
+    if (time_info)
+    {
+        plog::setBlockPosition(time_info->samplePos, time_info->ppqPos);
+        trace.setBlock(sample_frames, time_info->ppqPos);
+        LOGD_CAT(kLogTransport) << "      ppqPos: " << time_info->ppqPos;
+    }
+    LOGD_CAT(kLogTransport) << "sampleFrames: " << sample_frames;
 
-        while (prev_remainder_sample_frames_ + sample_frames - current_sample_cursor > samples_per_clock)
+    if (clock_generator_.getOutputs() != 0 && time_info)
+    {
+        // send timing clock and sync pulses
+        VstInt32 tick_frames[kMaxEvents];
+        unsigned int tick_events[kMaxEvents];
+        // a block at a high tempo and rate may hold more ticks than one call returns
+        VstInt32 tick_count = clock_generator_.process(time_info->tempo, time_info->sampleRate, sample_frames, tick_frames, tick_events, kMaxEvents);
+        for (; tick_count > 0; tick_count = clock_generator_.next(tick_frames, tick_events, kMaxEvents))
         {
-            double delta_frames = 0.0;
-            if (prev_remainder_sample_frames_ != 0)
+            for (VstInt32 i = 0; i < tick_count; ++i)
             {
-                delta_frames = samples_per_clock - abs(prev_remainder_sample_frames_);
-            }
-            else
-            {
-                delta_frames = current_sample_cursor + samples_per_clock;
-            }
+                if (tick_events[i] & kClockOutputMidiClock)
+                {
+                    char midi_data_clock[4] = { kClock, 0, 0, 0 };
+                    bool sent = transmitter->addMidiEvent(clock_port_, tick_frames[i], midi_data_clock);
+                    if (sent)
+                        ++telemetry_stats_.clocks_sent;
+                    LOGD_CAT(kLogClock) << "<< SEND MIDI EVENT: CLOCK >> "
+                        << "port: " << clock_port_ << " "
+                        << "deltaFrames: " << (sent ? tick_frames[i] : -1);
+                }
 
-            char midi_data_clock[4] = { kClock, 0, 0, 0 };
-            VstMidiEvent* ev = transmitter->addMidiEvent((VstInt32)delta_frames, 0, midi_data_clock);
-#if _DEBUG
-            LOGD << "<< SEND MIDI EVENT: CLOCK >> "
-                << "deltaFrames: " << ev->deltaFrames;
-#endif
-            current_sample_cursor = delta_frames;
-            prev_remainder_sample_frames_ = 0;
+                // pulse ends first, a pulse may end where another one starts
+                for (unsigned int output = 1; output < kClockOutputCount; ++output)
+                {
+                    if (tick_events[i] & (1u << (output + kClockOutputEndShift)))
+                    {
+                        char midi_data_pulse_off[4] = { (char)(kNoteOff + kSyncPulseChannel), kSyncPulseNotes[output], 0, 0 };
+                        transmitter->addMidiEvent(clock_port_, tick_frames[i], midi_data_pulse_off);
+                    }
+                }
+                for (unsigned int output = 1; output < kClockOutputCount; ++output)
+                {
+                    if (tick_events[i] & (1u << output))
+                    {
+                        char midi_data_pulse_on[4] = { (char)(kNoteOn + kSyncPulseChannel), kSyncPulseNotes[output], 127, 0 };
+                        transmitter->addMidiEvent(clock_port_, tick_frames[i], midi_data_pulse_on);
+                    }
+                }
+            }
         }
-        prev_remainder_sample_frames_ += sample_frames - current_sample_cursor;
-#if _DEBUG
-        LOGD << "remainderSampleFrames: " << prev_remainder_sample_frames_;
-#endif
+        LOGD_CAT(kLogClock) << "clock phase: " << clock_generator_.getPhase();
     }
     else
     {
-        sent_first_clock_ = false;
+        clock_generator_.reset();
     }
 
+    // program changes held back by the limiter, as room allows
+    VstInt32 room = kMaxEvents;
+    for (VstInt32 port = 0; port < kNumOutputPorts; ++port)
+    {
+        if (transmitter->getFreeEventCount(port) < room)
+            room = transmitter->getFreeEventCount(port);
+    }
+    PendingProgramChange due_changes[16 * kNumOutputPorts];
+    VstInt32 due_count = program_change_limiter_.takeDue(sample_frames, due_changes, room / 3 < 16 * kNumOutputPorts ? room / 3 : 16 * kNumOutputPorts);
+    for (VstInt32 i = 0; i < due_count; ++i)
+    {
+        sendProgramChange(due_changes[i].port, due_changes[i].target, due_changes[i].delta_frames);
+    }
+    program_change_limiter_.endBlock(sample_frames);
+
     // send events
-    transmitter->sendEvents();
+    trace.setEmittedEvents(transmitter->getQueuedEventCount() - queued_events);
+    transmitter->sendEvents(sample_frames, getSampleRate());
+
+    if (telemetry_.isOpen())
+    {
+        telemetry_stats_.dropped_events = 0;
+        for (VstInt32 port = 0; port < kNumOutputPorts; ++port)
+        {
+            telemetry_stats_.dropped_events += transmitter->getDroppedEventCount(port);
+        }
+        ++telemetry_stats_.blocks;
+        telemetry_stats_.held_notes = polyphony_;
+        telemetry_stats_.tempo = time_info ? time_info->tempo : 0.0;
+        telemetry_.publish(telemetry_stats_);
+    }
+
+    budget_monitor_.end(budget_begin);
+    double budget_used = budget_monitor_.endBlock(sample_frames, getSampleRate());
+    if (budget_used > budget_monitor_.getOverrunThreshold())
+    {
+        LOGW_CAT(kLogBudget) << "block used " << budget_used << " of its CPU budget, sampleFrames: " << sample_frames;
+    }
+
+    // records logged outside the block carry no position
+    plog::clearBlockPosition();
 }
 
 VstInt32 Ntpcs::canDo(char* text)
@@ -254,9 +545,10 @@ VstInt32 Ntpcs::canDo(char* text)
     return 0;
 }
 
+// MIDI channels the host may route, the output ports only exist in the merged event list
 VstInt32 Ntpcs::getNumMidiOutputChannels()
 {
-    return 2;
+    return 16;
 }
 
 bool Ntpcs::getProgramNameIndexed(VstInt32 category, VstInt32 index, char* text)
@@ -316,4 +608,10 @@ void Ntpcs::getParameterDisplay(VstInt32 index, char* text)
 void Ntpcs::getParameterName(VstInt32 index, char* text)
 {
     strcpy(text, "");
+}
+
+// Stats can be read and reset from any thread
+BudgetMonitor& Ntpcs::getBudgetMonitor()
+{
+    return budget_monitor_;
 }
\ No newline at end of file
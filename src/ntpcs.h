@@ -1,23 +1,50 @@
 #pragma once
 
-#if _DEBUG
 #include "logger.h"
-#endif
+#include "budgetmonitor.h"
+#include "cacheline.h"
+#include "capture.h"
+#include "clockgenerator.h"
+#include "eventbatch.h"
+#include "programlimiter.h"
+#include "retiredlist.h"
+#include "statechunk.h"
+#include "telemetry.h"
+#include <atomic>
 #include <cmath>
 #include "audioeffectx.h"
+#include "tracer.h"
 #include "transmitter.h"
+#include "zonemap.h"
 
 #define kNumPrograms 1
 #define kNumParams 0
 
 // NOTE: Enable GUI operation in the future
 #define kMidiClockTransmitterMode 0
+#define kMidiThruMode 0     // 1: forward the input merged with the generated events
+#define kSyncPulseOutputs 0 // ClockOutput bits sent as note pulses on the clock port
+#define kSyncPulseChannel 9 // MIDI channel of the sync pulse notes, counting from 0
+
+// note of each ClockOutput bit sent as a pulse
+const char kSyncPulseNotes[kClockOutputCount] = { 0, 35, 36, 37, 38 };
+
+// State restored by setChunk, waiting for the audio thread to take it
+struct PendingState
+{
+    NtpcsState state;
+    PendingState* next_retired;     // see RetiredList
+};
 
 class Ntpcs : public AudioEffectX
 {
 public:
     Ntpcs(audioMasterCallback);
     ~Ntpcs();
+    virtual void resume();
+    virtual void suspend();
+    virtual VstInt32 getChunk(void**, bool);
+    virtual VstInt32 setChunk(void*, VstInt32, bool);
     virtual VstInt32 processEvents(VstEvents*);
     virtual void processReplacing(float**, float**, VstInt32);
     virtual VstInt32 canDo(char*);
@@ -33,11 +60,36 @@ public:
     virtual void getParameterLabel(VstInt32, char*);
     virtual void getParameterDisplay(VstInt32, char*);
     virtual void getParameterName(VstInt32, char*);
+    BudgetMonitor& getBudgetMonitor();
 
 private:
-    EventTransmitter* transmitter;
+    void processNoteEvent(unsigned char, unsigned char, unsigned char, VstInt32);
+    void sendProgramChange(VstInt32, const ZoneTarget&, VstInt32);
+    void applyPendingState();
+
+    EventTransmitter* transmitter;  // allocated in resume, NULL while suspended
     char last_note_on_;         // note number of last pressed key
     unsigned int polyphony_;    // number of notes pressed simultaneously
-    double prev_remainder_sample_frames_;   // previous remainder samples
-    bool sent_first_clock_;                 // true if this plugin sent first timing clock
+    ClockGenerator clock_generator_;        // timing clock positions, carried across blocks
+    VstInt32 clock_port_;                   // output port of clock/start/stop
+    VstInt32 program_change_port_[16];      // output port of program change per input channel
+    VstInt32 sysex_port_;                   // output port of forwarded SysEx
+    bool midi_thru_;                        // forward input MIDI events
+    VstInt32 thru_port_;                    // output port of forwarded MIDI events
+    BudgetMonitor budget_monitor_;          // CPU time of each block against its real-time budget
+    SessionCapture* capture_;               // records host input if NTPCS_CAPTURE is set, else NULL, created by the first resume
+    EventBatch input_batch_;                // struct-of-arrays copy of the events being processed
+    ZoneMap zone_map_;                      // program, bank and output channel of each note on
+    ProgramChangeLimiter program_change_limiter_;   // minimum interval between program changes
+    std::vector<unsigned char> chunk_;      // state handed to the host by getChunk
+    bool opened_;                           // log, trace, capture and environment settings set up by the first resume
+    bool state_restored_;                   // setChunk was called, environment settings are ignored
+    NtpcsState restored_state_;             // last state passed to setChunk, what getChunk returns since
+    std::atomic<PendingState*> pending_state_;      // published by setChunk, applied at the start of a block
+    RetiredList<PendingState> retired_states_;      // applied, freed by the next setChunk
+    TelemetryPublisher telemetry_;          // live stats in shared memory if NTPCS_TELEMETRY is set
+    TelemetryStats telemetry_stats_;        // totals since resume, published every block
+
+    // keeps the next heap block, possibly another instance, off the cache lines above
+    char trailing_padding_[kCacheLineSize];
 };
\ No newline at end of file
@@ -0,0 +1,162 @@
+#include "programlimiter.h"
+#include <cstdlib>
+#include "logger.h"
+
+ProgramChangeLimiter::ProgramChangeLimiter()
+    : sample_rate_(44100.0)
+    , position_(0)
+    , delayed_(0)
+    , coalesced_(0)
+{
+    for (int port = 0; port < kNumOutputPorts; ++port)
+    {
+        for (int channel = 0; channel < 16; ++channel)
+        {
+            slots_[port][channel].last_sent = -1;
+            slots_[port][channel].pending = false;
+        }
+    }
+    setMinInterval(kProgramChangeMinInterval);
+}
+
+void ProgramChangeLimiter::setMinInterval(double milliseconds)
+{
+    for (int channel = 0; channel < 16; ++channel)
+    {
+        setMinInterval(channel, milliseconds);
+    }
+}
+
+void ProgramChangeLimiter::setMinInterval(int channel, double milliseconds)
+{
+    if (channel < 0 || channel > 15)
+    {
+        return;
+    }
+    interval_milliseconds_[channel] = milliseconds > 0 ? milliseconds : 0;
+    interval_samples_[channel] = (long long)(interval_milliseconds_[channel] * sample_rate_ / 1000.0 + 0.5);
+}
+
+double ProgramChangeLimiter::getMinInterval(int channel) const
+{
+    return channel < 0 || channel > 15 ? 0 : interval_milliseconds_[channel];
+}
+
+void ProgramChangeLimiter::setSampleRate(double sample_rate)
+{
+    if (sample_rate <= 0)
+    {
+        return;
+    }
+    sample_rate_ = sample_rate;
+    for (int channel = 0; channel < 16; ++channel)
+    {
+        setMinInterval(channel, interval_milliseconds_[channel]);
+    }
+}
+
+void ProgramChangeLimiter::loadFromEnvironment()
+{
+    const char* env = std::getenv("NTPCS_PC_INTERVAL");
+    if (!env || !*env)
+    {
+        return;
+    }
+
+    const char* p = env;
+    while (*p)
+    {
+        char* end;
+        double value = strtod(p, &end);
+        if (end == p)
+        {
+            LOGW_CAT(kLogEvents) << "Cannot parse NTPCS_PC_INTERVAL: " << env;
+            return;
+        }
+        if (*end == '=')
+        {
+            const char* milliseconds = end + 1;
+            double interval = strtod(milliseconds, &end);
+            if (end == milliseconds)
+            {
+                LOGW_CAT(kLogEvents) << "Cannot parse NTPCS_PC_INTERVAL: " << env;
+                return;
+            }
+            setMinInterval((int)value - 1, interval);
+        }
+        else
+        {
+            setMinInterval(value);
+        }
+
+        p = end;
+        while (*p == ',' || *p == ' ')
+            ++p;
+    }
+    LOGI_CAT(kLogEvents) << "Program change interval: " << env;
+}
+
+bool ProgramChangeLimiter::request(VstInt32 port, const ZoneTarget& target, VstInt32 delta_frames)
+{
+    int channel = target.channel & 0x0F;
+    if (interval_samples_[channel] == 0 || port < 0 || port >= kNumOutputPorts)
+    {
+        return true;
+    }
+
+    Slot& slot = slots_[port][channel];
+    long long time = position_ + delta_frames;
+    if (!slot.pending && (slot.last_sent < 0 || time >= slot.last_sent + interval_samples_[channel]))
+    {
+        slot.last_sent = time;
+        return true;
+    }
+
+    // latest wins, the waiting change is never sent
+    if (slot.pending)
+        ++coalesced_;
+    else
+        ++delayed_;
+    slot.pending = true;
+    slot.target = target;
+    return false;
+}
+
+VstInt32 ProgramChangeLimiter::takeDue(VstInt32 sample_frames, PendingProgramChange* out, VstInt32 max_changes)
+{
+    VstInt32 count = 0;
+    for (int port = 0; port < kNumOutputPorts; ++port)
+    {
+        for (int channel = 0; channel < 16; ++channel)
+        {
+            Slot& slot = slots_[port][channel];
+            if (!slot.pending || count >= max_changes)
+                continue;
+
+            long long due = getDueTime(channel, slot);
+            if (due >= position_ + sample_frames)
+                continue;
+
+            if (due < position_)
+                due = position_;
+            out[count].port = port;
+            out[count].delta_frames = (VstInt32)(due - position_);
+            out[count].target = slot.target;
+            ++count;
+
+            slot.pending = false;
+            slot.last_sent = due;
+        }
+    }
+    return count;
+}
+
+void ProgramChangeLimiter::endBlock(VstInt32 sample_frames)
+{
+    position_ += sample_frames;
+}
+
+long long ProgramChangeLimiter::getDueTime(int channel, const Slot& slot) const
+{
+    return slot.last_sent < 0 ? position_ : slot.last_sent + interval_samples_[channel];
+}
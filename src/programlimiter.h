@@ -0,0 +1,68 @@
+#pragma once
+
+#include "audioeffectx.h"
+#include "transmitter.h"
+#include "zonemap.h"
+
+#define kProgramChangeMinInterval 0.0   // default milliseconds between program changes of a channel, 0: no limit
+
+// Program change held back by ProgramChangeLimiter, sent once its interval has passed
+struct PendingProgramChange
+{
+    VstInt32 port;
+    VstInt32 delta_frames;      // within the block passed to takeDue
+    ZoneTarget target;
+};
+
+// Keeps program changes of each output port and channel a minimum interval apart,
+// for synths that drop or stutter when patches switch too fast.
+//
+// A change that comes too early waits in a single slot carried across blocks. A
+// later change for the same channel replaces it, so only the newest program is
+// sent when the interval has passed. Called by the audio thread only and never
+// allocates.
+class ProgramChangeLimiter
+{
+public:
+    ProgramChangeLimiter();
+
+    // not while processing
+    void setMinInterval(double milliseconds);
+    void setMinInterval(int channel, double milliseconds);
+    void setSampleRate(double sample_rate);
+    double getMinInterval(int channel) const;
+
+    // Reads NTPCS_PC_INTERVAL: milliseconds for all channels, optionally followed by
+    // channel=milliseconds overrides counting channels from 1, e.g. "10,3=20"
+    void loadFromEnvironment();
+
+    // returns true if the change can be sent at delta_frames, else holds it back
+    bool request(VstInt32 port, const ZoneTarget&, VstInt32 delta_frames);
+
+    // moves changes due within the next sample_frames to out, returns their number
+    VstInt32 takeDue(VstInt32 sample_frames, PendingProgramChange* out, VstInt32 max_changes);
+
+    // advances the position, once per processReplacing after takeDue
+    void endBlock(VstInt32 sample_frames);
+
+    unsigned int getDelayedCount() const { return delayed_; }
+    unsigned int getCoalescedCount() const { return coalesced_; }
+
+private:
+    struct Slot
+    {
+        long long last_sent;        // sample position of the last change sent, -1: none
+        bool pending;
+        ZoneTarget target;
+    };
+
+    long long getDueTime(int channel, const Slot&) const;
+
+    Slot slots_[kNumOutputPorts][16];
+    double interval_milliseconds_[16];
+    long long interval_samples_[16];
+    double sample_rate_;
+    long long position_;            // sample position of the current block
+    unsigned int delayed_;          // changes held back at least once
+    unsigned int coalesced_;        // held back changes replaced by a newer one
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// Objects the audio thread has replaced, handed back to be deleted on another
+// thread. push() neither blocks nor allocates and never waits for the other
+// side, so the audio thread can retire an object whenever it switches to a new
+// one. T links the list through its next_retired member.
+template<class T>
+class RetiredList
+{
+public:
+    RetiredList()
+        : head_(NULL)
+    {
+    }
+
+    ~RetiredList()
+    {
+        clear();
+    }
+
+    // audio thread
+    void push(T* object)
+    {
+        T* head = head_.load(std::memory_order_relaxed);
+        do
+        {
+            object->next_retired = head;
+        } while (!head_.compare_exchange_weak(head, object, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    // any thread but the audio thread, deletes everything retired so far
+    void clear()
+    {
+        T* object = head_.exchange(NULL, std::memory_order_acquire);
+        while (object)
+        {
+            T* next = object->next_retired;
+            delete object;
+            object = next;
+        }
+    }
+
+private:
+    std::atomic<T*> head_;  // taken whole by clear(), so a pushed object is never seen twice
+};
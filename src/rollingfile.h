@@ -0,0 +1,262 @@
+#pragma once
+
+#include <plog/Util.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace plog
+{
+    // Log file that rolls like RollingFileAppender: name.ext, name.1.ext, ... name.N.ext.
+    //
+    // While start()ed, a roller thread keeps the next file pre-opened as name.next.ext.
+    // A full file is then replaced by swapping descriptors, and the thread closes the
+    // old file, shifts the names and pre-opens another one, so the writing thread never
+    // pays for rotation. If the next file is not ready yet the current one keeps growing.
+    // Without start() files are rolled synchronously.
+    //
+    // prepare() and write() are not thread-safe, the owning appender serializes them.
+    class RollingFile : util::NonCopyable
+    {
+    public:
+        RollingFile(const util::nchar* fileName, size_t maxFileSize, int maxFiles, const std::string& header)
+            : m_fileSize()
+            , m_maxFileSize((std::max)(static_cast<off_t>(maxFileSize), static_cast<off_t>(1000))) // set a lower limit for the maxFileSize
+            , m_lastFileNumber((std::max)(maxFiles - 1, 0))
+            , m_header(header)
+            , m_firstWrite(true)
+            , m_nextFileSize()
+            , m_nextReady(false)
+            , m_rollPending(false)
+            , m_stopping(false)
+        {
+            util::splitFileName(fileName, m_fileNameNoExt, m_fileExt);
+        }
+
+        ~RollingFile()
+        {
+            stop();
+        }
+
+        void start()
+        {
+            if (m_lastFileNumber > 0 && !m_roller.joinable())
+            {
+                m_stopping = false;
+                m_roller = std::thread(&RollingFile::run, this);
+            }
+        }
+
+        // Must run before the module is unloaded, see ~Ntpcs.
+        void stop()
+        {
+            if (m_roller.joinable())
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_rollMutex);
+                    m_stopping = true;
+                }
+                m_rollWake.notify_one();
+                m_roller.join();
+
+                if (m_rollPending)
+                {
+                    retireFile();
+                    m_rollPending = false;
+                }
+                if (m_nextReady.load())
+                {
+                    m_nextFile.close();
+                    util::File::unlink(buildFileName(kNextFileNumber).c_str());
+                    m_nextReady.store(false);
+                }
+            }
+        }
+
+        // Opens the first file or moves on to the next one when the current one is full.
+        // Returns true when a new file became active.
+        bool prepare()
+        {
+            if (m_firstWrite)
+            {
+                openLogFile();
+                m_firstWrite = false;
+                return true;
+            }
+            else if (m_lastFileNumber > 0 && m_fileSize > m_maxFileSize && -1 != m_fileSize)
+            {
+                if (!m_roller.joinable())
+                {
+                    rollLogFiles();
+                    return true;
+                }
+                else if (m_nextReady.load(std::memory_order_acquire))
+                {
+                    switchToNextFile();
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        int write(const void* data, size_t size)
+        {
+            int bytesWritten = m_file.write(data, size);
+
+            if (bytesWritten > 0)
+            {
+                m_fileSize += bytesWritten;
+            }
+            return bytesWritten;
+        }
+
+        int sync()
+        {
+            return m_file.sync();
+        }
+
+    private:
+        void switchToNextFile()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_rollMutex);
+                m_file.swap(m_nextFile);    // m_nextFile now holds the full file for the roller
+                m_fileSize = m_nextFileSize;
+                m_nextReady.store(false, std::memory_order_relaxed);
+                m_rollPending = true;
+            }
+            m_rollWake.notify_one();
+        }
+
+        void run()
+        {
+            std::unique_lock<std::mutex> lock(m_rollMutex);
+            while (!m_stopping)
+            {
+                if (m_rollPending)
+                {
+                    lock.unlock();
+                    retireFile();
+                    lock.lock();
+                    m_rollPending = false;
+                }
+                else if (!m_nextReady.load(std::memory_order_relaxed))
+                {
+                    lock.unlock();
+                    openNextFile();
+                    lock.lock();
+                    m_nextReady.store(true, std::memory_order_release);
+                }
+                else
+                {
+                    m_rollWake.wait(lock);
+                }
+            }
+        }
+
+        // Closes the full file and shifts the names, the pre-opened file becomes name.ext
+        void retireFile()
+        {
+            m_nextFile.close();
+            shiftFileNames();
+            util::File::rename(buildFileName(kNextFileNumber).c_str(), buildFileName().c_str());
+        }
+
+        void openNextFile()
+        {
+            util::nstring fileName = buildFileName(kNextFileNumber);
+            util::File::unlink(fileName.c_str());
+            m_nextFileSize = m_nextFile.open(fileName.c_str());
+            m_nextFileSize += writeHeader(m_nextFile, m_nextFileSize);
+        }
+
+        void rollLogFiles()
+        {
+            m_file.close();
+            shiftFileNames();
+            openLogFile();
+        }
+
+        void shiftFileNames()
+        {
+            util::nstring lastFileName = buildFileName(m_lastFileNumber);
+            util::File::unlink(lastFileName.c_str());
+
+            for (int fileNumber = m_lastFileNumber - 1; fileNumber >= 0; --fileNumber)
+            {
+                util::nstring currentFileName = buildFileName(fileNumber);
+                util::nstring nextFileName = buildFileName(fileNumber + 1);
+
+                util::File::rename(currentFileName.c_str(), nextFileName.c_str());
+            }
+        }
+
+        void openLogFile()
+        {
+            util::nstring fileName = buildFileName();
+            m_fileSize = m_file.open(fileName.c_str());
+            m_fileSize += writeHeader(m_file, m_fileSize);
+        }
+
+        int writeHeader(util::File& file, off_t fileSize)
+        {
+            if (0 == fileSize && !m_header.empty())
+            {
+                int bytesWritten = file.write(m_header.data(), m_header.size());
+
+                if (bytesWritten > 0)
+                {
+                    return bytesWritten;
+                }
+            }
+            return 0;
+        }
+
+        util::nstring buildFileName(int fileNumber = 0)
+        {
+            util::nstringstream ss;
+            ss << m_fileNameNoExt;
+
+            if (fileNumber == kNextFileNumber)
+            {
+                ss << PLOG_NSTR(".next");
+            }
+            else if (fileNumber > 0)
+            {
+                ss << '.' << fileNumber;
+            }
+
+            if (!m_fileExt.empty())
+            {
+                ss << '.' << m_fileExt;
+            }
+
+            return ss.str();
+        }
+
+        static const int kNextFileNumber = -1;
+
+    private:
+        util::File          m_file;
+        off_t               m_fileSize;
+        const off_t         m_maxFileSize;
+        const int           m_lastFileNumber;
+        const std::string   m_header;
+        util::nstring       m_fileExt;
+        util::nstring       m_fileNameNoExt;
+        bool                m_firstWrite;
+
+        // owned by the roller thread while m_nextReady is false
+        util::File          m_nextFile;
+        off_t               m_nextFileSize;
+        std::atomic<bool>   m_nextReady;
+        bool                m_rollPending;
+        bool                m_stopping;
+        std::thread         m_roller;
+        std::mutex          m_rollMutex;
+        std::condition_variable m_rollWake;
+    };
+}
@@ -0,0 +1,142 @@
+#include "statechunk.h"
+#include <cstring>
+
+namespace
+{
+    void put16(unsigned char* p, unsigned int value)
+    {
+        p[0] = (unsigned char)value;
+        p[1] = (unsigned char)(value >> 8);
+    }
+
+    void put32(unsigned char* p, unsigned int value)
+    {
+        put16(p, value & 0xFFFF);
+        put16(p + 2, value >> 16);
+    }
+
+    unsigned int get16(const unsigned char* p)
+    {
+        return p[0] | (p[1] << 8);
+    }
+
+    unsigned int get32(const unsigned char* p)
+    {
+        return get16(p) | (get16(p + 2) << 16);
+    }
+
+    // offsets within the fixed part of version 1
+    enum StateOffset
+    {
+        kStateOffsetVersion = 4,
+        kStateOffsetHeaderBytes = 5,
+        kStateOffsetFlags = 7,
+        kStateOffsetClockPort = 8,
+        kStateOffsetSysexPort = 9,
+        kStateOffsetThruPort = 10,
+        kStateOffsetProgramChangePorts = 11,        // 16 bytes
+        kStateOffsetClockOutputs = 27,              // 32 bits
+        kStateOffsetProgramChangeIntervals = 31,    // 16 x 32 bits, microseconds
+    };
+
+    enum StateFlag
+    {
+        kStateFlagMidiThru = 1 << 0,
+    };
+
+    unsigned char encodeOptional(int value)
+    {
+        return value < 0 ? 0xFF : (unsigned char)value;
+    }
+
+    int decodeOptional(unsigned char value)
+    {
+        return value == 0xFF ? -1 : value;
+    }
+}
+
+void writeState(const NtpcsState& state, std::vector<unsigned char>& chunk)
+{
+    size_t rules = state.zone_rules.size() < kStateMaxRules ? state.zone_rules.size() : kStateMaxRules;
+    chunk.assign(kStateHeaderBytes + 2 + rules * kStateRuleBytes, 0);
+    unsigned char* p = &chunk[0];
+
+    memcpy(p, kStateMagic, kStateMagicLength);
+    p[kStateOffsetVersion] = kStateVersion;
+    put16(p + kStateOffsetHeaderBytes, kStateHeaderBytes);
+    p[kStateOffsetFlags] = state.midi_thru ? kStateFlagMidiThru : 0;
+    p[kStateOffsetClockPort] = (unsigned char)state.clock_port;
+    p[kStateOffsetSysexPort] = (unsigned char)state.sysex_port;
+    p[kStateOffsetThruPort] = (unsigned char)state.thru_port;
+    for (int ch = 0; ch < 16; ++ch)
+    {
+        p[kStateOffsetProgramChangePorts + ch] = (unsigned char)state.program_change_port[ch];
+        put32(p + kStateOffsetProgramChangeIntervals + ch * 4, (unsigned int)(state.program_change_interval[ch] * 1000.0 + 0.5));
+    }
+    put32(p + kStateOffsetClockOutputs, state.clock_outputs);
+
+    p += kStateHeaderBytes;
+    put16(p, (unsigned int)rules);
+    p += 2;
+    for (size_t i = 0; i < rules; ++i, p += kStateRuleBytes)
+    {
+        const ZoneRule& rule = state.zone_rules[i];
+        p[0] = encodeOptional(rule.channel);
+        p[1] = (unsigned char)rule.key_low;
+        p[2] = (unsigned char)rule.key_high;
+        p[3] = (unsigned char)rule.velocity_low;
+        p[4] = (unsigned char)rule.velocity_high;
+        p[5] = (unsigned char)rule.program;
+        put16(p + 6, rule.bank < 0 ? 0xFFFF : rule.bank);
+        p[8] = encodeOptional(rule.output_channel);
+        p[9] = 0;   // reserved
+    }
+}
+
+bool readState(const void* chunk, VstInt32 size, NtpcsState& state)
+{
+    const unsigned char* p = (const unsigned char*)chunk;
+    if (!p || size < kStateHeaderBytes || memcmp(p, kStateMagic, kStateMagicLength) != 0)
+    {
+        return false;
+    }
+
+    unsigned int header_bytes = get16(p + kStateOffsetHeaderBytes);
+    if (p[kStateOffsetVersion] == 0 || p[kStateOffsetVersion] > kStateVersion || header_bytes < kStateHeaderBytes || (VstInt32)header_bytes + 2 > size)
+    {
+        return false;
+    }
+
+    const unsigned char* rule_data = p + header_bytes + 2;
+    unsigned int rules = get16(p + header_bytes);
+    if ((VstInt32)(header_bytes + 2 + rules * kStateRuleBytes) > size)
+    {
+        return false;
+    }
+
+    state.midi_thru = (p[kStateOffsetFlags] & kStateFlagMidiThru) != 0;
+    state.clock_port = p[kStateOffsetClockPort];
+    state.sysex_port = p[kStateOffsetSysexPort];
+    state.thru_port = p[kStateOffsetThruPort];
+    for (int ch = 0; ch < 16; ++ch)
+    {
+        state.program_change_port[ch] = p[kStateOffsetProgramChangePorts + ch];
+        state.program_change_interval[ch] = get32(p + kStateOffsetProgramChangeIntervals + ch * 4) / 1000.0;
+    }
+    state.clock_outputs = get32(p + kStateOffsetClockOutputs);
+
+    state.zone_rules.resize(rules);
+    for (unsigned int i = 0; i < rules; ++i, rule_data += kStateRuleBytes)
+    {
+        ZoneRule& rule = state.zone_rules[i];
+        rule.channel = decodeOptional(rule_data[0]);
+        rule.key_low = rule_data[1];
+        rule.key_high = rule_data[2];
+        rule.velocity_low = rule_data[3];
+        rule.velocity_high = rule_data[4];
+        rule.program = rule_data[5];
+        rule.bank = get16(rule_data + 6) == 0xFFFF ? -1 : (int)get16(rule_data + 6);
+        rule.output_channel = decodeOptional(rule_data[8]);
+    }
+    return true;
+}
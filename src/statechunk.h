@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+#include "audioeffectx.h"
+#include "zonemap.h"
+
+#define kStateVersion 1
+#define kStateHeaderBytes 95        // fixed part of version 1, zone rules follow
+#define kStateRuleBytes 10          // bytes of each zone rule
+#define kStateMaxRules 65535
+
+// Magic of the state chunk returned by getChunk
+const char kStateMagic[] = "NTPS";
+const size_t kStateMagicLength = 4;
+
+// Options and mapping tables of one plugin instance
+struct NtpcsState
+{
+    bool midi_thru;
+    VstInt32 clock_port;
+    VstInt32 sysex_port;
+    VstInt32 thru_port;
+    VstInt32 program_change_port[16];
+    unsigned int clock_outputs;
+    double program_change_interval[16];     // milliseconds
+    std::vector<ZoneRule> zone_rules;
+};
+
+// State chunk: kStateMagic, version byte, 16-bit size of the fixed part, the
+// options at fixed offsets, 16-bit rule count, then the zone rules of
+// kStateRuleBytes each. Integers are little-endian.
+//
+// A later version only appends fields to the fixed part, so readState finds
+// the rules by the stored size and loads older chunks with the fields they
+// lack left at their defaults. Chunks of a version newer than kStateVersion are
+// rejected, their fields may change the meaning of the known ones. Reading is
+// one pass over the bytes, the rules are stored in a single allocation.
+void writeState(const NtpcsState&, std::vector<unsigned char>& chunk);
+bool readState(const void* chunk, VstInt32 size, NtpcsState&);
@@ -0,0 +1,74 @@
+#include "sysexpool.h"
+
+SysexPool::SysexPool()
+    : buffers_(NULL)
+    , storage_(NULL)
+    , free_list_(NULL)
+    , refused_(0)
+{
+}
+
+SysexPool::~SysexPool()
+{
+    free(buffers_);
+    free(storage_);
+}
+
+void SysexPool::reserve()
+{
+    if (buffers_)
+    {
+        return;
+    }
+
+    buffers_ = (SysexBuffer*)calloc(kSysexPoolBuffers, sizeof(SysexBuffer));
+    storage_ = (char*)malloc(kSysexPoolBuffers * kSysexBufferBytes);
+    for (int i = kSysexPoolBuffers - 1; i >= 0; --i)
+    {
+        buffers_[i].data = storage_ + i * kSysexBufferBytes;
+        buffers_[i].next_free = free_list_;
+        free_list_ = &buffers_[i];
+    }
+}
+
+bool SysexPool::isReserved() const
+{
+    return buffers_ != NULL;
+}
+
+SysexBuffer* SysexPool::acquire(const char* data, VstInt32 size)
+{
+    if (!free_list_ || size < 0 || size > kSysexBufferBytes)
+    {
+        ++refused_;
+        return NULL;
+    }
+
+    SysexBuffer* buffer = free_list_;
+    free_list_ = buffer->next_free;
+    if (size > 0)
+        memcpy(buffer->data, data, size);
+    buffer->size = size;
+    buffer->references = 1;
+    buffer->next_free = NULL;
+    return buffer;
+}
+
+void SysexPool::addRef(SysexBuffer* buffer)
+{
+    ++buffer->references;
+}
+
+void SysexPool::release(SysexBuffer* buffer)
+{
+    if (--buffer->references == 0)
+    {
+        buffer->next_free = free_list_;
+        free_list_ = buffer;
+    }
+}
+
+unsigned int SysexPool::getRefusedCount() const
+{
+    return refused_;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "audioeffectx.h"
+
+#define kSysexPoolBuffers 16        // SysEx messages that can be in flight at once
+#define kSysexBufferBytes 16384     // largest SysEx message forwarded
+
+// Payload of a forwarded SysEx message, shared by every output event that sends it
+struct SysexBuffer
+{
+    char* data;
+    VstInt32 size;
+    int references;
+    SysexBuffer* next_free;
+};
+
+// Fixed set of SysEx buffers, allocated by reserve() outside the audio thread.
+// acquire/addRef/release never allocate. They are called by the audio thread only,
+// so the reference counts are plain integers.
+class SysexPool
+{
+public:
+    SysexPool();
+    ~SysexPool();
+
+    // allocates the buffers once, later calls do nothing
+    void reserve();
+    bool isReserved() const;
+
+    // copies the message into a free buffer holding one reference,
+    // returns NULL if it is too large or all buffers are in use
+    SysexBuffer* acquire(const char* data, VstInt32 size);
+    void addRef(SysexBuffer*);
+    void release(SysexBuffer*);
+
+    unsigned int getRefusedCount() const;
+
+private:
+    SysexBuffer* buffers_;
+    char* storage_;
+    SysexBuffer* free_list_;
+    unsigned int refused_;      // messages not forwarded, too large or no free buffer
+};
@@ -0,0 +1,274 @@
+#include "telemetry.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    unsigned int getProcessId()
+    {
+#ifdef _WIN32
+        return GetCurrentProcessId();
+#else
+        return (unsigned int)getpid();
+#endif
+    }
+
+    // false only if the process is known to be gone, a reused id looks alive
+    bool isProcessAlive(unsigned int process_id)
+    {
+#ifdef _WIN32
+        HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, process_id);
+        if (!process)
+        {
+            return GetLastError() != ERROR_INVALID_PARAMETER;
+        }
+        DWORD exit_code = 0;
+        BOOL exited = GetExitCodeProcess(process, &exit_code) && exit_code != STILL_ACTIVE;
+        CloseHandle(process);
+        return !exited;
+#else
+        return kill((pid_t)process_id, 0) == 0 || errno != ESRCH;
+#endif
+    }
+
+    // Takes over a slot left by a process that exited without closing. Claiming
+    // the process id first lets only one of several openers win the slot.
+    bool reclaimSlot(TelemetrySlot& slot, unsigned int instance_id, unsigned int process_id)
+    {
+        unsigned int dead_process_id = slot.process_id.load(std::memory_order_relaxed);
+        if (slot.owner.load(std::memory_order_relaxed) == 0 || dead_process_id == 0 || dead_process_id == process_id || isProcessAlive(dead_process_id))
+        {
+            return false;
+        }
+        if (!slot.process_id.compare_exchange_strong(dead_process_id, process_id))
+        {
+            return false;
+        }
+        slot.owner.store(instance_id);
+        return true;
+    }
+}
+
+TelemetryMapping::TelemetryMapping()
+    : segment_(NULL)
+#ifdef _WIN32
+    , handle_(NULL)
+#endif
+{
+}
+
+TelemetryMapping::~TelemetryMapping()
+{
+    close();
+}
+
+bool TelemetryMapping::open(bool create)
+{
+    if (segment_)
+    {
+        return true;
+    }
+
+    // new segments are zero-filled, so every slot starts free
+    size_t size = sizeof(TelemetrySegment);
+#ifdef _WIN32
+    HANDLE handle = create
+        ? CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, (DWORD)size, kTelemetrySegmentName)
+        : OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, kTelemetrySegmentName);
+    if (!handle)
+    {
+        return false;
+    }
+    void* view = MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (!view)
+    {
+        CloseHandle(handle);
+        return false;
+    }
+    handle_ = handle;
+#else
+    int fd = shm_open(kTelemetrySegmentName, create ? O_RDWR | O_CREAT : O_RDWR, 0666);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || ((size_t)info.st_size < size && (!create || ftruncate(fd, size) != 0)))
+    {
+        ::close(fd);
+        return false;
+    }
+    void* view = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (view == MAP_FAILED)
+    {
+        return false;
+    }
+#endif
+
+    segment_ = (TelemetrySegment*)view;
+    if (create)
+    {
+        segment_->version.store(kTelemetryVersion);
+        segment_->magic.store(kTelemetryMagic);
+    }
+    else if (segment_->magic.load() != kTelemetryMagic || segment_->version.load() != kTelemetryVersion)
+    {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void TelemetryMapping::close()
+{
+    if (!segment_)
+    {
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(segment_);
+    CloseHandle(handle_);
+    handle_ = NULL;
+#else
+    munmap(segment_, sizeof(TelemetrySegment));
+#endif
+    segment_ = NULL;
+}
+
+TelemetryPublisher::TelemetryPublisher()
+    : slot_(NULL)
+    , sequence_(0)
+{
+}
+
+TelemetryPublisher::~TelemetryPublisher()
+{
+    close();
+}
+
+bool TelemetryPublisher::open()
+{
+    static std::atomic<unsigned int> instances(0);
+
+    if (slot_)
+    {
+        return true;
+    }
+
+    const char* env = std::getenv("NTPCS_TELEMETRY");
+    if (!env || !*env || strcmp(env, "0") == 0 || !mapping_.open(true))
+    {
+        return false;
+    }
+
+    unsigned int instance_id = ++instances;
+    unsigned int process_id = getProcessId();
+    TelemetrySegment* segment = mapping_.getSegment();
+    for (unsigned int i = 0; i < kTelemetrySlots * 2; ++i)
+    {
+        // free slots first, then those of processes that are gone
+        unsigned int free_owner = 0;
+        TelemetrySlot& slot = segment->slots[i % kTelemetrySlots];
+        if (i < kTelemetrySlots ? slot.owner.compare_exchange_strong(free_owner, instance_id) : reclaimSlot(slot, instance_id, process_id))
+        {
+            slot.process_id.store(process_id, std::memory_order_relaxed);
+            slot_ = &slot;
+            sequence_ = slot.sequence.load(std::memory_order_relaxed) & ~1u;
+
+            // clear what the previous owner left
+            TelemetryStats stats;
+            memset(&stats, 0, sizeof(stats));
+            publish(stats);
+            return true;
+        }
+    }
+
+    mapping_.close();
+    return false;
+}
+
+void TelemetryPublisher::close()
+{
+    if (!slot_)
+    {
+        return;
+    }
+
+    // the owner goes last, a monitor never lists a cleared slot
+    slot_->held_notes.store(0, std::memory_order_relaxed);
+    slot_->process_id.store(0, std::memory_order_relaxed);
+    slot_->owner.store(0, std::memory_order_release);
+    slot_ = NULL;
+    mapping_.close();
+}
+
+void TelemetryPublisher::publish(const TelemetryStats& stats)
+{
+    if (!slot_)
+    {
+        return;
+    }
+
+    unsigned long long tempo_bits;
+    memcpy(&tempo_bits, &stats.tempo, sizeof(tempo_bits));
+
+    slot_->sequence.store(++sequence_, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot_->held_notes.store(stats.held_notes, std::memory_order_relaxed);
+    slot_->blocks.store(stats.blocks, std::memory_order_relaxed);
+    slot_->input_events.store(stats.input_events, std::memory_order_relaxed);
+    slot_->clocks_sent.store(stats.clocks_sent, std::memory_order_relaxed);
+    slot_->program_changes_sent.store(stats.program_changes_sent, std::memory_order_relaxed);
+    slot_->dropped_events.store(stats.dropped_events, std::memory_order_relaxed);
+    slot_->tempo_bits.store(tempo_bits, std::memory_order_relaxed);
+    slot_->sequence.store(++sequence_, std::memory_order_release);
+}
+
+bool readTelemetrySlot(const TelemetrySlot& slot, TelemetryStats& stats)
+{
+    for (unsigned int retry = 0; retry < kTelemetryReadRetries; ++retry)
+    {
+        unsigned int owner = slot.owner.load(std::memory_order_acquire);
+        if (owner == 0)
+        {
+            return false;
+        }
+
+        unsigned int sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence & 1)
+        {
+            continue;   // being written
+        }
+
+        stats.instance_id = owner;
+        stats.process_id = slot.process_id.load(std::memory_order_relaxed);
+        stats.held_notes = slot.held_notes.load(std::memory_order_relaxed);
+        stats.blocks = slot.blocks.load(std::memory_order_relaxed);
+        stats.input_events = slot.input_events.load(std::memory_order_relaxed);
+        stats.clocks_sent = slot.clocks_sent.load(std::memory_order_relaxed);
+        stats.program_changes_sent = slot.program_changes_sent.load(std::memory_order_relaxed);
+        stats.dropped_events = slot.dropped_events.load(std::memory_order_relaxed);
+        unsigned long long tempo_bits = slot.tempo_bits.load(std::memory_order_relaxed);
+        memcpy(&stats.tempo, &tempo_bits, sizeof(stats.tempo));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) == sequence)
+        {
+            return true;
+        }
+    }
+    return false;
+}
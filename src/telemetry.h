@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include "cacheline.h"
+
+#define kTelemetrySlots 64              // instances a segment can list
+#define kTelemetryVersion 1
+#define kTelemetryMagic 0x5354504Eu     // "NPTS"
+#define kTelemetryReadRetries 1000      // reads of a slot that keeps changing before giving up
+
+#ifdef _WIN32
+#define kTelemetrySegmentName "Local\\ntpcs-telemetry"
+#else
+#define kTelemetrySegmentName "/ntpcs-telemetry"
+#endif
+
+// Values an instance publishes, totals since it was resumed
+struct TelemetryStats
+{
+    unsigned int process_id;
+    unsigned int instance_id;
+    unsigned long long blocks;
+    unsigned long long input_events;
+    unsigned long long clocks_sent;
+    unsigned long long program_changes_sent;
+    unsigned long long dropped_events;
+    unsigned int held_notes;
+    double tempo;
+};
+
+// One instance's stats in the shared segment. The writer makes sequence odd,
+// stores the fields and makes it even again, readers retry while it is odd or
+// changed under them. Every field is an atomic, so the stores are relaxed.
+// process_id is 0 while a slot is claimed or freed, a slot whose process has
+// exited without freeing it is taken over by the next instance that opens.
+struct TelemetrySlot
+{
+    std::atomic<unsigned int> owner;    // 0: free, else instance_id
+    std::atomic<unsigned int> sequence;
+    std::atomic<unsigned int> process_id;
+    std::atomic<unsigned int> held_notes;
+    std::atomic<unsigned long long> blocks;
+    std::atomic<unsigned long long> input_events;
+    std::atomic<unsigned long long> clocks_sent;
+    std::atomic<unsigned long long> program_changes_sent;
+    std::atomic<unsigned long long> dropped_events;
+    std::atomic<unsigned long long> tempo_bits;     // double
+};
+
+static_assert(sizeof(TelemetrySlot) == kCacheLineSize, "a slot fills one cache line");
+
+struct TelemetrySegment
+{
+    std::atomic<unsigned int> magic;
+    std::atomic<unsigned int> version;
+    char padding[kCacheLineSize - 8];
+    TelemetrySlot slots[kTelemetrySlots];
+};
+
+// Maps the named shared memory segment (a POSIX shared memory object, a named
+// file mapping on Windows) that plugin instances publish to and the monitor reads
+class TelemetryMapping
+{
+public:
+    TelemetryMapping();
+    ~TelemetryMapping();
+
+    // create: make the segment if no instance did yet
+    bool open(bool create);
+    void close();
+    TelemetrySegment* getSegment() const { return segment_; }
+
+private:
+    TelemetrySegment* segment_;
+#ifdef _WIN32
+    void* handle_;
+#endif
+};
+
+// Publishes one instance's stats. open/close claim and free a slot outside the
+// audio thread, publish costs the audio thread a few relaxed stores.
+class TelemetryPublisher
+{
+public:
+    TelemetryPublisher();
+    ~TelemetryPublisher();
+
+    // claims a slot if NTPCS_TELEMETRY is set, returns false otherwise
+    bool open();
+    void close();
+    bool isOpen() const { return slot_ != NULL; }
+
+    void publish(const TelemetryStats&);
+
+private:
+    TelemetryMapping mapping_;
+    TelemetrySlot* slot_;
+    unsigned int sequence_;
+};
+
+// Reads a slot consistently, returns false if the slot is free or its writer
+// left it mid-update
+bool readTelemetrySlot(const TelemetrySlot&, TelemetryStats&);
@@ -0,0 +1,293 @@
+#include "tracer.h"
+#include <plog/Util.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+TraceBuffer::TraceBuffer(unsigned int thread_index)
+    : thread_index_(thread_index)
+    , head_(0)
+    , dropped_spans_(0)
+    , tail_(0)
+{
+}
+
+// returns false and counts a drop if the writer has fallen behind
+bool TraceBuffer::push(const TraceSpan& span)
+{
+    unsigned int head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) >= kTraceBufferSpans)
+    {
+        dropped_spans_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    spans_[head % kTraceBufferSpans] = span;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+bool TraceBuffer::pop(TraceSpan& span)
+{
+    unsigned int tail = tail_.load(std::memory_order_relaxed);
+    if (tail == head_.load(std::memory_order_acquire))
+    {
+        return false;
+    }
+
+    span = spans_[tail % kTraceBufferSpans];
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+unsigned int TraceBuffer::getThreadIndex() const
+{
+    return thread_index_;
+}
+
+unsigned long long TraceBuffer::getDroppedSpanCount() const
+{
+    return dropped_spans_.load(std::memory_order_relaxed);
+}
+
+namespace
+{
+    struct TraceState
+    {
+        TraceState() : reserved(0), claimed(0), unclaimed_spans(0), users(0), file(NULL), first_event(true), start_ns(0), stopping(false) {}
+
+        // buffers reserved by open(), threads claim them in order
+        TraceBuffer* pool[kTraceMaxThreads];
+        std::atomic<unsigned int> reserved;
+        std::atomic<unsigned int> claimed;
+        std::atomic<unsigned long long> unclaimed_spans;    // spans of threads that found no buffer
+
+        std::mutex lifecycle_mutex;             // serializes open and close
+        std::mutex mutex;                       // guards everything below except the wakeup
+        std::vector<std::unique_ptr<TraceBuffer> > buffers;
+        int users;
+        FILE* file;
+        bool first_event;
+        unsigned long long start_ns;
+        std::map<const void*, int> instances;   // plugin instance -> pid of the trace
+        std::thread writer;
+        std::mutex wake_mutex;
+        std::condition_variable wake;
+        bool stopping;
+    };
+
+    TraceState& state()
+    {
+        static TraceState trace_state;
+        return trace_state;
+    }
+
+    thread_local TraceBuffer* thread_buffer = NULL;
+
+    void writeEvent(TraceState& s, const char* json)
+    {
+        fputs(s.first_event ? "\n" : ",\n", s.file);
+        fputs(json, s.file);
+        s.first_event = false;
+    }
+
+    int getInstanceId(TraceState& s, const void* instance)
+    {
+        std::map<const void*, int>::iterator it = s.instances.find(instance);
+        if (it != s.instances.end())
+        {
+            return it->second;
+        }
+
+        int id = static_cast<int>(s.instances.size()) + 1;
+        s.instances.insert(std::make_pair(instance, id));
+
+        // names the track of the instance in the viewer
+        char json[128];
+        snprintf(json, sizeof(json), "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"Ntpcs #%d\"}}", id, id);
+        writeEvent(s, json);
+        return id;
+    }
+
+    void writeSpan(TraceState& s, const TraceSpan& span, unsigned int thread_index)
+    {
+        int pid = getInstanceId(s, span.instance);
+        double ts = span.begin_ns >= s.start_ns ? (span.begin_ns - s.start_ns) / 1000.0 : 0.0;
+        double dur = span.end_ns >= span.begin_ns ? (span.end_ns - span.begin_ns) / 1000.0 : 0.0;
+
+        char json[256];
+        snprintf(json, sizeof(json),
+            "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+            "\"args\":{\"events\":%d,\"block\":%d,\"ppq\":%.6f,\"emitted\":%d}}",
+            span.name, pid, thread_index, ts, dur,
+            int(span.event_count), int(span.block_size), span.ppq_pos, int(span.emitted_events));
+        writeEvent(s, json);
+    }
+
+    // writes out every span buffered so far, discarding them if no file is open
+    void drain(TraceState& s)
+    {
+        TraceSpan span;
+        for (size_t i = 0; i < s.buffers.size(); ++i)
+        {
+            TraceBuffer* buffer = s.buffers[i].get();
+            while (buffer->pop(span))
+            {
+                if (s.file)
+                {
+                    writeSpan(s, span, buffer->getThreadIndex());
+                }
+            }
+        }
+    }
+
+    void run()
+    {
+        TraceState& s = state();
+        std::unique_lock<std::mutex> lock(s.wake_mutex);
+        while (!s.stopping)
+        {
+            s.wake.wait_for(lock, std::chrono::milliseconds(kTraceDrainInterval));
+            lock.unlock();
+            {
+                std::lock_guard<std::mutex> state_lock(s.mutex);
+                drain(s);
+            }
+            lock.lock();
+        }
+    }
+
+    // Keeps a buffer unclaimed for every open instance, buffers claimed by the
+    // threads of an earlier session stay theirs. Called with lifecycle_mutex held,
+    // outside the audio thread.
+    void reserveBuffer(TraceState& s)
+    {
+        unsigned int reserved = s.reserved.load(std::memory_order_relaxed);
+        if (reserved >= kTraceMaxThreads || reserved - s.claimed.load(std::memory_order_relaxed) >= static_cast<unsigned int>(s.users))
+        {
+            return;
+        }
+
+        TraceBuffer* buffer = new TraceBuffer(reserved + 1);
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            s.buffers.push_back(std::unique_ptr<TraceBuffer>(buffer));
+        }
+        s.pool[reserved] = buffer;
+        s.reserved.store(reserved + 1, std::memory_order_release);
+    }
+
+    // audio thread: takes the next reserved buffer, NULL if all are taken
+    TraceBuffer* claimBuffer()
+    {
+        TraceState& s = state();
+        unsigned int claimed = s.claimed.load(std::memory_order_relaxed);
+        while (claimed < s.reserved.load(std::memory_order_acquire))
+        {
+            if (s.claimed.compare_exchange_weak(claimed, claimed + 1, std::memory_order_relaxed))
+            {
+                return s.pool[claimed];
+            }
+        }
+        return NULL;
+    }
+}
+
+namespace tracer
+{
+    void open()
+    {
+        TraceState& s = state();
+        std::lock_guard<std::mutex> lifecycle_lock(s.lifecycle_mutex);
+        if (s.users++ > 0)
+        {
+            if (s.writer.joinable())
+            {
+                reserveBuffer(s);
+            }
+            return;
+        }
+
+        const char* file_name = std::getenv("NTPCS_TRACE");
+        if (!file_name || !*file_name)
+        {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            s.file = fopen(file_name, "w");
+            if (!s.file)
+            {
+                return;
+            }
+
+            drain(s);   // leftovers of a previous session
+            fputs("{\"traceEvents\":[", s.file);
+            s.first_event = true;
+            s.start_ns = now();
+            s.instances.clear();
+        }
+
+        reserveBuffer(s);
+        s.stopping = false;
+        s.writer = std::thread(run);
+        enabledFlag().store(true);
+    }
+
+    // Must run before the module is unloaded, see ~Ntpcs.
+    void close()
+    {
+        TraceState& s = state();
+        std::lock_guard<std::mutex> lifecycle_lock(s.lifecycle_mutex);
+        if (--s.users > 0 || !s.writer.joinable())
+        {
+            return;
+        }
+
+        enabledFlag().store(false);
+        {
+            std::lock_guard<std::mutex> wake_lock(s.wake_mutex);
+            s.stopping = true;
+        }
+        s.wake.notify_one();
+        s.writer.join();
+
+        std::lock_guard<std::mutex> lock(s.mutex);
+        drain(s);
+        unsigned long long dropped_spans = 0;
+        for (size_t i = 0; i < s.buffers.size(); ++i)
+        {
+            dropped_spans += s.buffers[i]->getDroppedSpanCount();
+        }
+        dropped_spans += s.unclaimed_spans.exchange(0);
+        fprintf(s.file, "\n],\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped_spans\":\"%llu\"}}\n", dropped_spans);
+        fclose(s.file);
+        s.file = NULL;
+    }
+
+    unsigned long long now()
+    {
+        return plog::util::monotonicNanos();
+    }
+
+    void record(const TraceSpan& span)
+    {
+        if (!thread_buffer)
+        {
+            thread_buffer = claimBuffer();
+            if (!thread_buffer)
+            {
+                state().unclaimed_spans.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+        thread_buffer->push(span);
+    }
+}
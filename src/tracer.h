@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include "audioeffectx.h"
+#include "cacheline.h"
+
+#define kTraceBufferSpans 4096  // spans each thread can hold until the writer drains them
+#define kTraceDrainInterval 100 // milliseconds between drains of the writer thread
+#define kTraceMaxThreads 64     // threads that can record spans, one buffer is reserved per open instance up to this
+
+// One timed call of the plugin
+struct TraceSpan
+{
+    const char* name;           // static string
+    const void* instance;       // plugin instance that made the call
+    unsigned long long begin_ns;
+    unsigned long long end_ns;
+    VstInt32 event_count;       // events received (processEvents) or sent (sendEvents)
+    VstInt32 block_size;        // sample frames of the block, 0 if unknown
+    double ppq_pos;             // position of the block, -1 if unknown
+    VstInt32 emitted_events;    // events queued for output during the call
+};
+
+// Single-producer single-consumer ring owned by one thread. The owning thread
+// pushes without locks, the writer thread pops.
+class TraceBuffer
+{
+public:
+    TraceBuffer(unsigned int thread_index);
+    bool push(const TraceSpan&);
+    bool pop(TraceSpan&);
+    unsigned int getThreadIndex() const;
+    unsigned long long getDroppedSpanCount() const;
+
+private:
+    TraceSpan spans_[kTraceBufferSpans];
+    unsigned int thread_index_;
+
+    // indices of the two threads on separate cache lines
+    char head_padding_[kCacheLineSize];
+    std::atomic<unsigned int> head_;    // next slot to write, advanced by the owner
+    std::atomic<unsigned long long> dropped_spans_;
+    char tail_padding_[kCacheLineSize];
+    std::atomic<unsigned int> tail_;    // next slot to read, advanced by the writer
+    char trailing_padding_[kCacheLineSize];
+};
+
+// Records per-block spans of all plugin instances of the process and writes them
+// as Chrome trace JSON (chrome://tracing, ui.perfetto.dev). Enabled by setting the
+// NTPCS_TRACE environment variable to the output file name.
+namespace tracer
+{
+    // Shared by all instances, the first open starts the writer thread and the last
+    // close joins it and completes the file. Each open reserves a buffer for one
+    // more thread while tracing is enabled.
+    void open();
+    void close();
+
+    inline std::atomic<bool>& enabledFlag()
+    {
+        static std::atomic<bool> enabled(false);
+        return enabled;
+    }
+
+    inline bool isEnabled()
+    {
+        return enabledFlag().load(std::memory_order_relaxed);
+    }
+
+    unsigned long long now();
+
+    // Hands the span to the buffer of the calling thread. The first call of each
+    // thread claims a reserved buffer without locking, spans of threads that find
+    // none left are dropped.
+    void record(const TraceSpan&);
+}
+
+// Times the enclosing scope while tracing is enabled
+class TraceScope
+{
+public:
+    TraceScope(const char* name, const void* instance)
+        : active_(tracer::isEnabled())
+    {
+        if (active_)
+        {
+            span_.name = name;
+            span_.instance = instance;
+            span_.event_count = 0;
+            span_.block_size = 0;
+            span_.ppq_pos = -1;
+            span_.emitted_events = 0;
+            span_.begin_ns = tracer::now();
+        }
+    }
+
+    ~TraceScope()
+    {
+        if (active_)
+        {
+            span_.end_ns = tracer::now();
+            tracer::record(span_);
+        }
+    }
+
+    void setEventCount(VstInt32 count) { span_.event_count = count; }
+    void setBlock(VstInt32 block_size, double ppq_pos) { span_.block_size = block_size; span_.ppq_pos = ppq_pos; }
+    void setEmittedEvents(VstInt32 count) { span_.emitted_events = count; }
+
+private:
+    bool active_;
+    TraceSpan span_;
+};
@@ -1,55 +1,315 @@
 #include "transmitter.h"
+#include "logger.h"
+#include "tracer.h"
 
-EventTransmitter::EventTransmitter(AudioEffectX* plugin)
+namespace
+{
+    // message types of the packed words, as in the Universal MIDI Packet
+    enum PacketType
+    {
+        kPacketSystem = 0x1,
+        kPacketChannelVoice = 0x2,
+        kPacketSysex = 0x3,
+    };
+
+    inline unsigned int packWord(unsigned int type, VstInt32 group, unsigned int payload)
+    {
+        return (type << 28) | ((group & 0x0F) << 24) | (payload & 0xFFFFFF);
+    }
+}
+
+EventTransmitter::EventTransmitter(AudioEffectX* plugin, VstInt32 event_capacity)
     : plugin_(plugin)
-    , event_count_(0)
+    , event_capacity_(event_capacity < kMinEvents ? kMinEvents : event_capacity > kMaxEvents ? kMaxEvents : event_capacity)
+    , sent_sysex_count_(0)
 {
-    // init events
-    size_t size = sizeof(VstEvents) + kMaxEvents * sizeof(VstEvent*);
-    out_events_ = (VstEvents*)malloc(size);
-    for (unsigned int i = 0; i < kMaxEvents; ++i)
+    // merged event list first, then the SysEx, expanded and packed events, each
+    // part keeps the alignment of the pointers it starts with
+    VstInt32 total_events = kNumOutputPorts * event_capacity_;     // SysEx included
+    size_t out_events_size = sizeof(VstEvents) + total_events * sizeof(VstEvent*);
+    out_events_size = (out_events_size + sizeof(void*) - 1) / sizeof(void*) * sizeof(void*);
+    size_t sysex_events_size = kNumOutputPorts * kMaxSysexEvents * sizeof(VstMidiSysexEvent);
+    size_t out_midi_events_size = total_events * sizeof(VstMidiEvent);
+    size_t merged_events_size = total_events * sizeof(PackedEvent);
+    size_t events_size = total_events * sizeof(PackedEvent);
+    storage_ = calloc(1, out_events_size + sysex_events_size + out_midi_events_size + merged_events_size + events_size);
+    char* storage = (char*)storage_;
+
+    // init merged events (pointers are filled in sendEvents)
+    out_events_ = (VstEvents*)storage;
+    storage += out_events_size;
+    VstMidiSysexEvent* sysex_events = (VstMidiSysexEvent*)storage;
+    storage += sysex_events_size;
+    out_midi_events_ = (VstMidiEvent*)storage;
+    storage += out_midi_events_size;
+    merged_events_ = (PackedEvent*)storage;
+    storage += merged_events_size;
+    PackedEvent* events = (PackedEvent*)storage;
+
+    for (VstInt32 i = 0; i < total_events; ++i)
     {
-        out_events_->events[i] = (VstEvent*)calloc(1, sizeof(VstMidiEvent));
-        VstEvent* ev = out_events_->events[i];
-        ev->type = kVstMidiType;
-        ev->byteSize = sizeof(VstMidiEvent);
+        out_midi_events_[i].type = kVstMidiType;
+        out_midi_events_[i].byteSize = sizeof(VstMidiEvent);
+    }
+
+    // init port queues
+    for (unsigned int p = 0; p < kNumOutputPorts; ++p)
+    {
+        PortQueue& port = ports_[p];
+        port.events = events + p * event_capacity_;
+        port.event_count = 0;
+        port.block_bytes = 0;
+        port.last_block_bytes = 0;
+        port.dropped_events = 0;
+        port.overrun_blocks = 0;
+
+        port.sysex_events = sysex_events + p * kMaxSysexEvents;
+        port.sysex_count = 0;
+        for (unsigned int i = 0; i < kMaxSysexEvents; ++i)
+        {
+            port.sysex_events[i].type = kVstSysExType;
+            port.sysex_events[i].byteSize = sizeof(VstMidiSysexEvent);
+            port.sysex_buffers[i] = NULL;
+        }
     }
 }
 
 EventTransmitter::~EventTransmitter()
 {
-    for (unsigned int i = 0; i < kMaxEvents; ++i)
+    free(storage_);
+}
+
+VstInt32 EventTransmitter::getEventCapacity(VstInt32 block_size, double sample_rate)
+{
+    if (block_size <= 0 || sample_rate <= 0)
     {
-        free(out_events_->events[i]);
+        return kMaxEvents;
     }
-    free(out_events_);
+
+    VstInt32 wire_bytes = (VstInt32)std::ceil(block_size * kMidiBytesPerSecond / sample_rate);
+    VstInt32 capacity = kMinEvents + 2 * wire_bytes;
+    return capacity > kMaxEvents ? kMaxEvents : capacity;
 }
 
-VstInt32 EventTransmitter::getEventCount()
+VstInt32 EventTransmitter::getEventCount(VstInt32 port)
 {
-    return event_count_;
+    return ports_[port].event_count;
 }
 
-VstMidiEvent* EventTransmitter::addMidiEvent(VstInt32 delta_frames, VstInt32 note_length, char midi_data[4])
+VstInt32 EventTransmitter::getFreeEventCount(VstInt32 port)
 {
-    VstMidiEvent* ev = (VstMidiEvent*)out_events_->events[event_count_];
-    ++event_count_;
+    return event_capacity_ - ports_[port].event_count;
+}
+
+// events waiting in all ports
+VstInt32 EventTransmitter::getQueuedEventCount()
+{
+    VstInt32 count = 0;
+    for (unsigned int p = 0; p < kNumOutputPorts; ++p)
+    {
+        count += ports_[p].event_count;
+    }
+    return count;
+}
+
+// returns false if the queue of the port is full
+bool EventTransmitter::addMidiEvent(VstInt32 port, VstInt32 delta_frames, const char midi_data[4])
+{
+    PortQueue& queue = ports_[port];
+    if (queue.event_count >= event_capacity_)
+    {
+        ++queue.dropped_events;
+        LOGW_CAT(kLogTransmitter) << "port " << port << " queue full, dropped event: " << int(midi_data[0]);
+        return false;
+    }
+
+    unsigned char status = (unsigned char)midi_data[0];
+    PackedEvent& ev = queue.events[queue.event_count];
+    ++queue.event_count;
+    queue.block_bytes += getMidiMessageLength(midi_data[0]);
+    ev.word = packWord(status >= 0xF0 ? kPacketSystem : kPacketChannelVoice, port,
+        (status << 16) | ((unsigned char)midi_data[1] << 8) | (unsigned char)midi_data[2]);
+    ev.delta_frames = delta_frames;
+
+    return true;
+}
+
+// Copies the message into a pooled buffer, returns NULL if the pool or the queue
+// of the port is exhausted
+VstMidiSysexEvent* EventTransmitter::addSysexEvent(VstInt32 port, VstInt32 delta_frames, const char* data, VstInt32 size)
+{
+    SysexBuffer* buffer = sysex_pool_.acquire(data, size);
+    if (!buffer)
+    {
+        ++ports_[port].dropped_events;
+        LOGW_CAT(kLogTransmitter) << "port " << port << " no SysEx buffer for " << size << " bytes";
+        return NULL;
+    }
+
+    VstMidiSysexEvent* ev = addSysexEvent(port, delta_frames, buffer);
+    sysex_pool_.release(buffer);
+    return ev;
+}
+
+// Sends a buffer that may be queued on other ports as well, takes a reference
+VstMidiSysexEvent* EventTransmitter::addSysexEvent(VstInt32 port, VstInt32 delta_frames, SysexBuffer* buffer)
+{
+    PortQueue& queue = ports_[port];
+    if (queue.sysex_count >= kMaxSysexEvents)
+    {
+        ++queue.dropped_events;
+        LOGW_CAT(kLogTransmitter) << "port " << port << " SysEx queue full, dropped " << buffer->size << " bytes";
+        return NULL;
+    }
+
+    if (queue.event_count >= event_capacity_)
+    {
+        ++queue.dropped_events;
+        LOGW_CAT(kLogTransmitter) << "port " << port << " queue full, dropped " << buffer->size << " SysEx bytes";
+        return NULL;
+    }
+
+    // ordered with the other events through a packed word naming the SysEx slot
+    PackedEvent& packed = queue.events[queue.event_count];
+    ++queue.event_count;
+    packed.word = packWord(kPacketSysex, port, queue.sysex_count);
+    packed.delta_frames = delta_frames;
+
+    sysex_pool_.addRef(buffer);
+    queue.sysex_buffers[queue.sysex_count] = buffer;
+    VstMidiSysexEvent* ev = &queue.sysex_events[queue.sysex_count];
+    ++queue.sysex_count;
+    queue.block_bytes += buffer->size;
     ev->deltaFrames = delta_frames;
-    ev->noteLength = note_length;
-    ev->midiData[0] = midi_data[0];
-    ev->midiData[1] = midi_data[1];
-    ev->midiData[2] = midi_data[2];
-    ev->midiData[3] = midi_data[3];
+    ev->dumpBytes = buffer->size;
+    ev->sysexDump = buffer->data;
 
     return ev;
 }
 
-void EventTransmitter::sendEvents()
+// reserve() the pool from resume(), not on the audio thread
+SysexPool& EventTransmitter::getSysexPool()
 {
-    if (event_count_ > 0)
+    return sysex_pool_;
+}
+
+void EventTransmitter::sendEvents(VstInt32 sample_frames, double sample_rate)
+{
+    TraceScope trace("sendEvents", plugin_);
+    trace.setBlock(sample_frames, -1);
+
+    // bytes the wire of one port can carry during this block
+    double block_byte_budget = sample_rate > 0 ? kMidiBytesPerSecond * sample_frames / sample_rate : 0;
+
+    // the host has consumed the SysEx of the previous block
+    releaseSentSysex();
+
+    // merge all ports into one list ordered by deltaFrames, moving 8 bytes per event
+    VstInt32 count = 0;
+    for (unsigned int p = 0; p < kNumOutputPorts; ++p)
     {
-        out_events_->numEvents = event_count_;
+        PortQueue& queue = ports_[p];
+        for (VstInt32 i = 0; i < queue.event_count; ++i)
+        {
+            insertEvent(queue.events[i], count);
+        }
+        for (VstInt32 i = 0; i < queue.sysex_count; ++i)
+        {
+            sent_sysex_[sent_sysex_count_++] = queue.sysex_buffers[i];
+        }
+
+        if (block_byte_budget > 0 && queue.block_bytes > block_byte_budget)
+        {
+            ++queue.overrun_blocks;
+            LOGW_CAT(kLogTransmitter) << "port " << p << " over MIDI bandwidth: " << queue.block_bytes << " bytes in " << sample_frames << " samples";
+        }
+        queue.last_block_bytes = queue.block_bytes;
+        queue.block_bytes = 0;
+        queue.event_count = 0;
+        queue.sysex_count = 0;
+    }
+
+    // expand for the host only now
+    VstInt32 midi_count = 0;
+    for (VstInt32 i = 0; i < count; ++i)
+    {
+        unsigned int word = merged_events_[i].word;
+        if ((word >> 28) == kPacketSysex)
+        {
+            VstMidiSysexEvent* sysex = &ports_[(word >> 24) & 0x0F].sysex_events[word & 0xFFFF];
+            sysex->deltaFrames = merged_events_[i].delta_frames;
+            out_events_->events[i] = (VstEvent*)sysex;
+        }
+        else
+        {
+            VstMidiEvent* ev = &out_midi_events_[midi_count++];
+            ev->deltaFrames = merged_events_[i].delta_frames;
+            ev->midiData[0] = (char)(word >> 16);
+            ev->midiData[1] = (char)(word >> 8);
+            ev->midiData[2] = (char)word;
+            ev->midiData[3] = 0;
+            out_events_->events[i] = (VstEvent*)ev;
+        }
+    }
+
+    trace.setEventCount(count);
+    trace.setEmittedEvents(count);
+    if (count > 0)
+    {
+        out_events_->numEvents = count;
         plugin_->sendVstEventsToHost(out_events_);
-        event_count_ = 0;
     }
-}
\ No newline at end of file
+}
+
+VstInt32 EventTransmitter::getLastBlockBytes(VstInt32 port)
+{
+    return ports_[port].last_block_bytes;
+}
+
+unsigned int EventTransmitter::getDroppedEventCount(VstInt32 port)
+{
+    return ports_[port].dropped_events;
+}
+
+unsigned int EventTransmitter::getOverrunBlockCount(VstInt32 port)
+{
+    return ports_[port].overrun_blocks;
+}
+
+// inserts after events with the same deltaFrames, keeping the port order
+void EventTransmitter::insertEvent(const PackedEvent& ev, VstInt32& count)
+{
+    VstInt32 j = count;
+    while (j > 0 && merged_events_[j - 1].delta_frames > ev.delta_frames)
+    {
+        merged_events_[j] = merged_events_[j - 1];
+        --j;
+    }
+    merged_events_[j] = ev;
+    ++count;
+}
+
+void EventTransmitter::releaseSentSysex()
+{
+    for (VstInt32 i = 0; i < sent_sysex_count_; ++i)
+    {
+        sysex_pool_.release(sent_sysex_[i]);
+    }
+    sent_sysex_count_ = 0;
+}
+
+VstInt32 EventTransmitter::getMidiMessageLength(char status)
+{
+    unsigned char s = (unsigned char)status;
+    if (s >= 0xF8)
+        return 1;   // system realtime
+    if (s == 0xF1 || s == 0xF3)
+        return 2;
+    if (s == 0xF2)
+        return 3;
+    if (s >= 0xF0)
+        return 1;
+    if (s >= 0xC0 && s < 0xE0)
+        return 2;   // program change, channel pressure
+    return 3;
+}
@@ -2,27 +2,89 @@
 
 #include <cmath>
 #include "audioeffectx.h"
+#include "cacheline.h"
+#include "sysexpool.h"
 
-#define kMaxEvents 64
+#define kMaxEvents 256          // largest capacity of each output port queue, thru traffic included
+#define kMinEvents 64           // smallest capacity of each output port queue
+#define kMaxSysexEvents 8       // SysEx capacity of each output port queue
+#define kNumOutputPorts 2       // number of routable output ports
+#define kMidiBytesPerSecond 3125.0  // MIDI DIN wire rate (31250 baud, 10 bits per byte)
 
 const char kNoteOff = 0x80;
 const char kNoteOn = 0x90;
+const char kControlChange = 0xB0;
 const char kProgramChange = 0xC0;
 const char kClock = 0xF8;
 const char kStart = 0xFA;
 const char kStop = 0xFC;
 
+enum OutputPort
+{
+    kPortA = 0,
+    kPortB = 1,
+};
+
 class EventTransmitter
 {
 public:
-    EventTransmitter(AudioEffectX*);
+    EventTransmitter(AudioEffectX*, VstInt32 event_capacity = kMaxEvents);
     ~EventTransmitter();
-    VstInt32 getEventCount();
-    VstMidiEvent* addMidiEvent(VstInt32, VstInt32, char[4]);
-    void sendEvents();
+    VstInt32 getEventCount(VstInt32);
+    VstInt32 getFreeEventCount(VstInt32);
+    VstInt32 getQueuedEventCount();
+    bool addMidiEvent(VstInt32, VstInt32, const char[4]);
+    VstMidiSysexEvent* addSysexEvent(VstInt32, VstInt32, const char*, VstInt32);
+    VstMidiSysexEvent* addSysexEvent(VstInt32, VstInt32, SysexBuffer*);
+    SysexPool& getSysexPool();
+    void sendEvents(VstInt32, double);
+    VstInt32 getLastBlockBytes(VstInt32);
+    unsigned int getDroppedEventCount(VstInt32);
+    unsigned int getOverrunBlockCount(VstInt32);
+
+    // port queue capacity for the host's block size: twice what the wire carries
+    // per block on top of kMinEvents, at most kMaxEvents
+    static VstInt32 getEventCapacity(VstInt32 block_size, double sample_rate);
 
 private:
+    // Queued event: a 32-bit Universal MIDI Packet style word and the frame offset.
+    // MIDI 1.0 messages keep their status and data bytes in the low 24 bits under
+    // message type kPacketChannelVoice or kPacketSystem, the group is the port.
+    // kPacketSysex words refer to a SysEx event of the port by index.
+    struct PackedEvent
+    {
+        unsigned int word;
+        VstInt32 delta_frames;
+    };
+
+    struct PortQueue
+    {
+        PackedEvent* events;            // pre-sized queue of event_capacity_ events, SysEx included
+        VstInt32 event_count;
+        VstMidiSysexEvent* sysex_events;    // pre-sized queue of kMaxSysexEvents events
+        SysexBuffer* sysex_buffers[kMaxSysexEvents];    // payload referenced by each SysEx event
+        VstInt32 sysex_count;
+        VstInt32 block_bytes;           // MIDI bytes queued in current block
+        VstInt32 last_block_bytes;      // MIDI bytes sent in previous block
+        unsigned int dropped_events;    // events refused because the queue was full
+        unsigned int overrun_blocks;    // blocks that exceeded the wire budget
+    };
+
+    static VstInt32 getMidiMessageLength(char);
+    void insertEvent(const PackedEvent&, VstInt32& count);
+    void releaseSentSysex();
+
+    // written every block, padded so no other instance's state shares its cache lines
+    char leading_padding_[kCacheLineSize];
     AudioEffectX* plugin_;
-    VstInt32 event_count_;
-    VstEvents* out_events_;
-};
\ No newline at end of file
+    VstInt32 event_capacity_;
+    void* storage_;                     // every queue below, one allocation
+    PortQueue ports_[kNumOutputPorts];
+    PackedEvent* merged_events_;        // all ports ordered by deltaFrames, built by sendEvents
+    VstMidiEvent* out_midi_events_;     // merged_events_ expanded for the host
+    VstEvents* out_events_;             // merged list of all ports handed to host
+    SysexPool sysex_pool_;
+    SysexBuffer* sent_sysex_[kNumOutputPorts * kMaxSysexEvents];   // held until the host consumed them
+    VstInt32 sent_sysex_count_;
+    char trailing_padding_[kCacheLineSize];
+};
@@ -0,0 +1,209 @@
+#include "zonemap.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "logger.h"
+
+namespace
+{
+    int clampInt(int value, int low, int high)
+    {
+        return value < low ? low : value > high ? high : value;
+    }
+}
+
+ZoneMap::ZoneMap()
+    : active_(NULL)
+    , pending_(NULL)
+    , reserved_(false)
+{
+}
+
+ZoneMap::~ZoneMap()
+{
+    delete active_;
+    delete pending_.load();
+}
+
+void ZoneMap::setRules(const std::vector<ZoneRule>& rules)
+{
+    std::lock_guard<std::mutex> lock(rules_mutex_);
+    rules_ = rules;
+    if (!reserved_)
+    {
+        return;     // reserve() compiles them
+    }
+
+    ZoneTable* table = compile(rules);
+
+    // a table the audio thread never picked up can go at once, the ones it
+    // replaced since the last call are handed back through retired_
+    delete pending_.exchange(table);
+    retired_.clear();
+}
+
+std::vector<ZoneRule> ZoneMap::getRules() const
+{
+    std::lock_guard<std::mutex> lock(rules_mutex_);
+    return rules_;
+}
+
+bool ZoneMap::loadFromEnvironment()
+{
+    const char* env = std::getenv("NTPCS_ZONES");
+    if (!env || !*env)
+    {
+        return false;
+    }
+
+    FILE* file = fopen(env, "r");
+    if (!file)
+    {
+        LOGW_CAT(kLogEvents) << "Cannot open zone file " << env;
+        return false;
+    }
+
+    std::vector<ZoneRule> rules;
+    char line[256];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        ++line_number;
+        char* comment = strchr(line, '#');
+        if (comment)
+            *comment = '\0';
+
+        ZoneRule rule;
+        int bank = -1;
+        int output_channel = 0;
+        int fields = sscanf(line, "%d %d %d %d %d %d %d %d",
+            &rule.channel, &rule.key_low, &rule.key_high,
+            &rule.velocity_low, &rule.velocity_high, &rule.program,
+            &bank, &output_channel);
+        if (fields <= 0)
+        {
+            continue;       // blank line or comment
+        }
+        if (fields < 6)
+        {
+            LOGW_CAT(kLogEvents) << "Zone file " << env << ":" << line_number << ": expected at least 6 fields";
+            continue;
+        }
+
+        rule.channel = rule.channel > 0 ? rule.channel - 1 : kZoneAnyChannel;
+        rule.bank = bank;
+        rule.output_channel = output_channel > 0 ? output_channel - 1 : -1;
+        rules.push_back(rule);
+    }
+    fclose(file);
+
+    LOGI_CAT(kLogEvents) << "Loaded " << rules.size() << " zone rules from " << env;
+    setRules(rules);
+    return true;
+}
+
+void ZoneMap::reserve()
+{
+    std::lock_guard<std::mutex> lock(rules_mutex_);
+    if (reserved_)
+    {
+        return;
+    }
+
+    reserved_ = true;
+    active_ = compile(rules_);
+}
+
+void ZoneMap::update()
+{
+    ZoneTable* table = pending_.exchange(NULL);
+    if (table)
+    {
+        retired_.push(active_);
+        active_ = table;
+    }
+}
+
+ZoneTable* ZoneMap::compile(const std::vector<ZoneRule>& rules)
+{
+    // a band starts at 0 and at every velocity a rule starts at or ends before
+    bool band_starts[129] = { true };
+    for (size_t i = 0; i < rules.size(); ++i)
+    {
+        band_starts[clampInt(rules[i].velocity_low, 0, 127)] = true;
+        band_starts[clampInt(rules[i].velocity_high, 0, 127) + 1] = true;
+    }
+
+    ZoneTable* table = new ZoneTable;
+    table->bands = 0;
+    table->next_retired = NULL;
+    for (int velocity = 0; velocity < 128; ++velocity)
+    {
+        if (band_starts[velocity])
+            ++table->bands;
+        table->velocity_band[velocity] = (unsigned char)(table->bands - 1);
+    }
+
+    table->targets.resize(16 * 128 * table->bands);
+    for (int channel = 0; channel < 16; ++channel)
+    {
+        for (int key = 0; key < 128; ++key)
+        {
+            ZoneTarget* entry = &table->targets[(channel * 128 + key) * table->bands];
+            for (unsigned int band = 0; band < table->bands; ++band)
+            {
+                entry[band].program = (unsigned char)key;
+                entry[band].bank_msb = kZoneNoBank;
+                entry[band].bank_lsb = 0;
+                entry[band].channel = (unsigned char)channel;
+            }
+        }
+    }
+
+    // rules of single channels override the rules for all channels
+    for (size_t i = 0; i < rules.size(); ++i)
+    {
+        if (rules[i].channel == kZoneAnyChannel)
+            apply(table, rules[i]);
+    }
+    for (size_t i = 0; i < rules.size(); ++i)
+    {
+        if (rules[i].channel != kZoneAnyChannel)
+            apply(table, rules[i]);
+    }
+    return table;
+}
+
+void ZoneMap::apply(ZoneTable* table, const ZoneRule& rule)
+{
+    int channel_low = rule.channel == kZoneAnyChannel ? 0 : clampInt(rule.channel, 0, 15);
+    int channel_high = rule.channel == kZoneAnyChannel ? 15 : channel_low;
+    int key_low = clampInt(rule.key_low, 0, 127);
+    int key_high = clampInt(rule.key_high, 0, 127);
+    int velocity_low = clampInt(rule.velocity_low, 0, 127);
+    int velocity_high = clampInt(rule.velocity_high, 0, 127);
+    if (velocity_low > velocity_high)
+    {
+        return;
+    }
+    int band_low = table->velocity_band[velocity_low];
+    int band_high = table->velocity_band[velocity_high];
+
+    for (int channel = channel_low; channel <= channel_high; ++channel)
+    {
+        ZoneTarget target;
+        target.program = (unsigned char)clampInt(rule.program, 0, 127);
+        target.bank_msb = rule.bank < 0 ? kZoneNoBank : (unsigned char)((clampInt(rule.bank, 0, 16383) >> 7) & 0x7F);
+        target.bank_lsb = rule.bank < 0 ? 0 : (unsigned char)(clampInt(rule.bank, 0, 16383) & 0x7F);
+        target.channel = (unsigned char)(rule.output_channel < 0 ? channel : clampInt(rule.output_channel, 0, 15));
+
+        for (int key = key_low; key <= key_high; ++key)
+        {
+            ZoneTarget* entry = &table->targets[(channel * 128 + key) * table->bands];
+            for (int band = band_low; band <= band_high; ++band)
+            {
+                entry[band] = target;
+            }
+        }
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "audioeffectx.h"
+#include "retiredlist.h"
+
+#define kZoneNoBank 0xFF            // ZoneTarget::bank_msb when no bank select is sent
+#define kZoneAnyChannel -1
+
+// What a note on selects, four bytes so one load fetches it
+struct ZoneTarget
+{
+    unsigned char program;
+    unsigned char bank_msb;     // kZoneNoBank: program change only
+    unsigned char bank_lsb;
+    unsigned char channel;      // output channel 0-15
+};
+
+// Notes of channel (kZoneAnyChannel for all) within the key and velocity ranges,
+// both inclusive, select program. bank is 0-16383 or -1 for none, output_channel
+// is 0-15 or -1 to keep the input channel.
+struct ZoneRule
+{
+    int channel;
+    int key_low;
+    int key_high;
+    int velocity_low;
+    int velocity_high;
+    int program;
+    int bank;
+    int output_channel;
+};
+
+// Compiled rules. Velocities between the same rule boundaries share a band,
+// so the table holds a target per channel, key and band and still resolves
+// every velocity.
+struct ZoneTable
+{
+    unsigned char velocity_band[128];
+    unsigned int bands;
+    std::vector<ZoneTarget> targets;    // (channel * 128 + key) * bands + band
+    ZoneTable* next_retired;            // see RetiredList
+};
+
+// Key/velocity zones compiled into a lookup table of every channel, key and
+// velocity band.
+//
+// setRules compiles a new table outside the audio thread and publishes it, the
+// audio thread picks it up in update() and resolves a note on with two indexed
+// loads, however many rules there are. Rules for all channels apply first, then
+// the rules of single channels, later rules win within each group. Notes that
+// match no rule select the program of their note number on their own channel.
+// No table exists before reserve(), until then setRules only keeps the rules.
+class ZoneMap
+{
+public:
+    ZoneMap();
+    ~ZoneMap();
+
+    // any thread but the audio thread
+    void setRules(const std::vector<ZoneRule>&);
+    std::vector<ZoneRule> getRules() const;
+
+    // Reads rules from the file named by NTPCS_ZONES, one per line:
+    //   channel key_low key_high velocity_low velocity_high program [bank [output_channel]]
+    // channel and output_channel count from 1, 0 means any channel or the input
+    // channel, bank -1 means none. Text after # is ignored.
+    bool loadFromEnvironment();
+
+    // compiles the first table, outside the audio thread before it calls update()
+    void reserve();
+
+    // audio thread: switches to the latest published table
+    void update();
+    const ZoneTarget& lookup(unsigned char channel, unsigned char key, unsigned char velocity) const
+    {
+        const ZoneTable& table = *active_;
+        return table.targets[((channel & 0x0F) * 128 + (key & 0x7F)) * table.bands + table.velocity_band[velocity & 0x7F]];
+    }
+
+private:
+    static ZoneTable* compile(const std::vector<ZoneRule>&);
+    static void apply(ZoneTable*, const ZoneRule&);
+
+    ZoneTable* active_;                     // owned by the audio thread, NULL before reserve()
+    std::atomic<ZoneTable*> pending_;       // published, not yet picked up
+    RetiredList<ZoneTable> retired_;        // replaced by update(), freed by the next setRules
+    mutable std::mutex rules_mutex_;
+    std::vector<ZoneRule> rules_;
+    bool reserved_;                         // tables are compiled, guarded by rules_mutex_
+};
@@ -0,0 +1,318 @@
+// clocksuite: run the clock generator over simulated days of transport and check
+// every timing clock against its exact position.
+//
+//   clocksuite [runs] [hours] [threads]
+//
+// Each run plays hours of audio with its own seed: block sizes fixed or varying
+// from call to call, tempo ramps between 20 and 300 BPM, and sample rate changes
+// between 44.1 and 192 kHz. The outputs besides the timing clock vary by run.
+// Runs go to all cores by default.
+//
+// The exact position is kept as a whole tick and a fraction with a common
+// denominator of every tempo and rate, so the reference itself does not drift.
+// A clock is due at the whole sample at or before its position. Clocks sent are
+// matched to the exact ones by their sample in the session, so a clock the
+// generator moves into the next block is not lost. Reported:
+//   drift     largest distance of a clock from its exact position, in samples,
+//             over the first and the last hour and over all of them
+//   jitter    clocks by distance from their exact position
+//   missing   clocks due but never sent
+//   duplicate clocks sent without one due
+//   boundary  clocks within kSuiteBoundary of a whole sample, sent at the
+//             sample on the other side of it: the generator snaps positions
+//             just below a whole sample onto it
+//   misplaced other clocks sent at another sample than the one at or before
+//             their exact position
+//
+// Exits with 1 if a clock is missing, duplicate or misplaced, or drifts more
+// than a sample.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <random>
+#include <thread>
+#include <vector>
+#include "clockgenerator.h"
+
+#define kSuiteRuns 64               // default runs, a seed each
+#define kSuiteHours 24              // default hours of audio per run
+#define kSuiteMaxBlockSize 4096
+#define kSuiteMaxTicks 16           // events a call returns, blocks with more go through next()
+#define kSuiteRateLcm 28224000ULL   // least common multiple of the sample rates
+#define kSuiteJitterBins 10         // bins of 1/8 sample from -1 to 0, below and above
+#define kSuiteBoundary (2 * kClockSnap)   // samples from a whole sample the generator may place either side
+
+namespace
+{
+    const unsigned int kSuiteSampleRates[] = { 44100, 48000, 88200, 96000, 176400, 192000 };
+    const unsigned int kSuiteClockStride = kClockTicksPerBeat / kClocksPerBeat;
+
+    // tick position of the session as whole + fraction / kSuiteDenominator
+    const unsigned long long kSuiteDenominator = 60000ULL * kSuiteRateLcm;
+
+    struct Result
+    {
+        Result()
+            : clocks(0)
+            , missing(0)
+            , duplicate(0)
+            , boundary(0)
+            , misplaced(0)
+            , drift(0)
+            , first_hour_drift(0)
+            , last_hour_drift(0)
+        {
+            std::fill(jitter, jitter + kSuiteJitterBins, 0ULL);
+        }
+
+        void add(const Result& other)
+        {
+            clocks += other.clocks;
+            missing += other.missing;
+            duplicate += other.duplicate;
+            boundary += other.boundary;
+            misplaced += other.misplaced;
+            drift = (std::max)(drift, other.drift);
+            first_hour_drift = (std::max)(first_hour_drift, other.first_hour_drift);
+            last_hour_drift = (std::max)(last_hour_drift, other.last_hour_drift);
+            for (int i = 0; i < kSuiteJitterBins; ++i)
+            {
+                jitter[i] += other.jitter[i];
+            }
+        }
+
+        unsigned long long clocks;
+        unsigned long long missing;
+        unsigned long long duplicate;
+        unsigned long long boundary;
+        unsigned long long misplaced;
+        double drift;
+        double first_hour_drift;
+        double last_hour_drift;
+        unsigned long long jitter[kSuiteJitterBins];  // below -1, 8 bins to 0, above 0
+    };
+
+    // a clock due or sent, at offset within the block starting at sample start
+    struct Clock
+    {
+        unsigned long long start;
+        double offset;
+    };
+
+    int jitterBin(double error)
+    {
+        if (error < -1.0)
+            return 0;
+        if (error > 0.0)
+            return kSuiteJitterBins - 1;
+        int bin = 1 + (int)((error + 1.0) * 8);
+        return bin < kSuiteJitterBins - 2 ? bin : kSuiteJitterBins - 2;
+    }
+
+    // one host session of hours of audio
+    Result run(unsigned int seed, unsigned int hours)
+    {
+        std::mt19937 random(seed);
+        Result result;
+
+        ClockGenerator generator;
+        generator.setOutputs(kClockOutputMidiClock | (random() % (1u << kClockOutputCount)));
+
+        unsigned long long whole = 0;       // exact position, tick 0 is due at the first sample
+        unsigned long long fraction = 0;
+
+        unsigned int sample_rate = kSuiteSampleRates[0];
+        unsigned int tempo = 120000;        // thousandths of a BPM
+        unsigned int tempo_target = tempo;
+        unsigned int tempo_step = 0;
+        unsigned int block_size = 512;
+        bool varying_blocks = false;
+        double seconds = 0;
+        double next_rate_change = 0;
+        double next_tempo_change = 0;
+        double next_host_change = 0;
+        double end = hours * 3600.0;
+
+        VstInt32 delta_frames[kSuiteMaxTicks];
+        unsigned int events[kSuiteMaxTicks];
+        std::deque<Clock> due;              // exact clocks not yet matched
+        std::deque<Clock> sent;             // clocks sent not yet matched
+        unsigned long long sample = 0;      // start of the block in the session
+        while (seconds < end)
+        {
+            if (seconds >= next_rate_change)
+            {
+                sample_rate = kSuiteSampleRates[random() % (sizeof(kSuiteSampleRates) / sizeof(kSuiteSampleRates[0]))];
+                next_rate_change = seconds + 60.0 * (1 + random() % 240);
+            }
+            if (seconds >= next_tempo_change)
+            {
+                // a ramp to a new tempo over up to 256 blocks, or a jump
+                tempo_target = 20000 + random() % 280001;
+                unsigned int ramp_blocks = random() % 257;
+                tempo_step = ramp_blocks ? (std::max)(1u, (tempo > tempo_target ? tempo - tempo_target : tempo_target - tempo) / ramp_blocks) : 300000;
+                next_tempo_change = seconds + 1.0 + random() % 60;
+            }
+            if (seconds >= next_host_change)
+            {
+                varying_blocks = random() % 2 != 0;
+                block_size = 32u << (random() % 7);
+                next_host_change = seconds + 60.0 * (1 + random() % 60);
+            }
+            if (tempo != tempo_target)
+            {
+                if (tempo < tempo_target)
+                    tempo = tempo_target - tempo > tempo_step ? tempo + tempo_step : tempo_target;
+                else
+                    tempo = tempo - tempo_target > tempo_step ? tempo - tempo_step : tempo_target;
+            }
+            VstInt32 sample_frames = varying_blocks ? 1 + (VstInt32)(random() % kSuiteMaxBlockSize) : (VstInt32)block_size;
+
+            VstInt32 count = generator.process(tempo / 1000.0, sample_rate, sample_frames, delta_frames, events, kSuiteMaxTicks);
+            for (; count > 0; count = generator.next(delta_frames, events, kSuiteMaxTicks))
+            {
+                for (VstInt32 i = 0; i < count; ++i)
+                {
+                    if (events[i] & kClockOutputMidiClock)
+                    {
+                        Clock clock = { sample, (double)delta_frames[i] };
+                        sent.push_back(clock);
+                    }
+                }
+            }
+
+            // ticks per sample as a fraction of kSuiteDenominator
+            unsigned long long ticks_per_sample = (unsigned long long)tempo * kClockTicksPerBeat * (kSuiteRateLcm / sample_rate);
+            unsigned long long end_fraction = fraction + sample_frames * ticks_per_sample;
+            unsigned long long end_whole = whole + end_fraction / kSuiteDenominator;
+            end_fraction %= kSuiteDenominator;
+
+            // clocks due in [position, end position)
+            unsigned long long tick = whole + (fraction != 0 ? 1 : 0);
+            tick = (tick + kSuiteClockStride - 1) / kSuiteClockStride * kSuiteClockStride;
+            for (; tick < end_whole || (tick == end_whole && end_fraction != 0); tick += kSuiteClockStride)
+            {
+                Clock clock = { sample, ((tick - whole) * kSuiteDenominator - fraction) / (double)ticks_per_sample };
+                due.push_back(clock);
+            }
+
+            // a clock is settled once the other queue has one near it, or when the
+            // block has passed the last sample it could be sent at
+            while (!due.empty() && !sent.empty())
+            {
+                const Clock& exact = due.front();
+                double error = (double)(long long)(sent.front().start - exact.start) + sent.front().offset - exact.offset;
+                if (error < -1.0 - kSuiteBoundary)
+                {
+                    ++result.duplicate;
+                    sent.pop_front();
+                    continue;
+                }
+                if (error > kSuiteBoundary)
+                {
+                    ++result.missing;
+                    due.pop_front();
+                    continue;
+                }
+
+                double drift = std::fabs(error);
+                result.drift = (std::max)(result.drift, drift);
+                if (seconds < 3600.0)
+                    result.first_hour_drift = (std::max)(result.first_hour_drift, drift);
+                if (seconds >= end - 3600.0)
+                    result.last_hour_drift = (std::max)(result.last_hour_drift, drift);
+                ++result.jitter[jitterBin(error)];
+
+                // samples from the one at or before the exact position
+                double floor_offset = std::floor(exact.offset);
+                double shift = (double)(long long)(sent.front().start - exact.start) + sent.front().offset - floor_offset;
+                if (shift == 1.0 && floor_offset + 1.0 - exact.offset < kSuiteBoundary)
+                    ++result.boundary;
+                else if (shift == -1.0 && exact.offset - floor_offset < kSuiteBoundary)
+                    ++result.boundary;
+                else if (shift != 0.0)
+                    ++result.misplaced;
+                ++result.clocks;
+                due.pop_front();
+                sent.pop_front();
+            }
+            while (!due.empty() && sample + sample_frames > due.front().start + (unsigned long long)due.front().offset + 1)
+            {
+                ++result.missing;
+                due.pop_front();
+            }
+            while (!sent.empty() && sample + sample_frames > sent.front().start + (unsigned long long)sent.front().offset + 1)
+            {
+                ++result.duplicate;
+                sent.pop_front();
+            }
+
+            whole = end_whole;
+            fraction = end_fraction;
+            sample += sample_frames;
+            seconds += (double)sample_frames / sample_rate;
+        }
+        result.missing += due.size();
+        result.duplicate += sent.size();
+        return result;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int runs = argc > 1 ? strtoul(argv[1], NULL, 10) : kSuiteRuns;
+    unsigned int hours = argc > 2 ? strtoul(argv[2], NULL, 10) : kSuiteHours;
+    unsigned int threads = argc > 3 ? strtoul(argv[3], NULL, 10) : (std::max)(std::thread::hardware_concurrency(), 1u);
+    if (runs == 0 || hours == 0 || threads == 0)
+    {
+        fprintf(stderr, "usage: clocksuite [runs] [hours] [threads]\n");
+        return 2;
+    }
+
+    printf("%u runs of %u hours on %u threads\n", runs, hours, threads);
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+
+    std::vector<Result> results(runs);
+    std::atomic<unsigned int> next_run(0);
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < threads; ++i)
+    {
+        workers.push_back(std::thread([&]() {
+            for (unsigned int seed = next_run++; seed < runs; seed = next_run++)
+            {
+                results[seed] = run(seed + 1, hours);
+            }
+        }));
+    }
+    for (size_t i = 0; i < workers.size(); ++i)
+    {
+        workers[i].join();
+    }
+
+    Result total;
+    for (unsigned int i = 0; i < runs; ++i)
+    {
+        total.add(results[i]);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    printf("clocks:    %llu in %.1f s\n", total.clocks, seconds);
+    printf("drift:     %.6f samples, first hour %.6f, last hour %.6f\n", total.drift, total.first_hour_drift, total.last_hour_drift);
+    printf("jitter:    below -1 %llu\n", total.jitter[0]);
+    for (int i = 1; i < kSuiteJitterBins - 1; ++i)
+    {
+        printf("           %6.3f to %6.3f %llu\n", -1.0 + (i - 1) / 8.0, -1.0 + i / 8.0, total.jitter[i]);
+    }
+    printf("           above 0 %llu\n", total.jitter[kSuiteJitterBins - 1]);
+    printf("missing:   %llu\n", total.missing);
+    printf("duplicate: %llu\n", total.duplicate);
+    printf("boundary:  %llu\n", total.boundary);
+    printf("misplaced: %llu\n", total.misplaced);
+
+    return total.missing == 0 && total.duplicate == 0 && total.misplaced == 0 && total.drift <= 1.0 + kSuiteBoundary ? 0 : 1;
+}
@@ -0,0 +1,539 @@
+// hostbench: run many plugin instances the way a multi-core host does.
+//
+//   hostbench scale [instances] [blocks] [threads]
+//   hostbench open [instances]
+//   hostbench load [instances] [rules]
+//
+// scale:  instances process the same blocks of note ons, note offs and program
+//         changes, a work-stealing pool spreads them over 1, 2, 4... threads
+//         up to threads, every core by default. Reports the wall time of each
+//         block, from handing out the instances to the last one finishing, and
+//         the speedup over one thread. Shared state between instances shows as
+//         poor scaling.
+// open:   the cost of a project load or plugin scan: constructing instances,
+//         resuming them at the first block, suspending and deleting them, each
+//         step for all instances in turn.
+// load:   a project load restoring state: setChunk with zone rules and options
+//         into suspended instances, then the resume that compiles the zones.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include "ntpcs.h"
+
+#define kBenchInstances 256         // default instances of scale
+#define kBenchBlocks 2000           // default blocks of scale
+#define kBenchBlockSize 512
+#define kBenchSampleRate 44100.0f
+#define kBenchMaxEvents 16          // input events of one block
+#define kBenchOpenInstances 1000    // default instances of open and load
+#define kBenchLoadRules 32          // default zone rules of the state of load
+
+namespace
+{
+    VstTimeInfo g_time_info;
+
+    VstIntPtr VSTCALLBACK hostCallback(AEffect* effect, VstInt32 opcode, VstInt32 index, VstIntPtr value, void* ptr, float opt)
+    {
+        switch (opcode)
+        {
+        case audioMasterVersion:
+            return kVstVersion;
+        case audioMasterGetTime:
+            return (VstIntPtr)&g_time_info;
+        case audioMasterProcessEvents:
+            return 1;
+        }
+        return 0;
+    }
+
+    // VstEvents with room for the events of a block
+    struct BenchEvents
+    {
+        VstInt32 numEvents;
+        VstIntPtr reserved;
+        VstEvent* events[kBenchMaxEvents];
+    };
+
+    struct BenchBlock
+    {
+        VstMidiEvent midi[kBenchMaxEvents];
+        BenchEvents events;
+    };
+
+    // a player on every channel, changing programs now and then
+    void makeBlocks(std::vector<BenchBlock>& blocks)
+    {
+        std::mt19937 random(1);
+        unsigned char held[16] = { 0 };
+        for (size_t b = 0; b < blocks.size(); ++b)
+        {
+            BenchBlock& block = blocks[b];
+            memset(&block, 0, sizeof(block));
+            VstInt32 count = random() % 6;
+            for (VstInt32 i = 0; i < count; ++i)
+            {
+                VstMidiEvent& midi = block.midi[i];
+                midi.type = kVstMidiType;
+                midi.byteSize = sizeof(VstMidiEvent);
+                midi.deltaFrames = (VstInt32)(random() % kBenchBlockSize);
+                unsigned char channel = (unsigned char)(random() % 16);
+                unsigned int kind = random() % 8;
+                if (kind == 0)
+                {
+                    midi.midiData[0] = (char)(0xC0 | channel);
+                    midi.midiData[1] = (char)(random() % 128);
+                }
+                else if (held[channel] != 0)
+                {
+                    midi.midiData[0] = (char)(0x80 | channel);
+                    midi.midiData[1] = (char)held[channel];
+                    held[channel] = 0;
+                }
+                else
+                {
+                    held[channel] = (unsigned char)(1 + random() % 127);
+                    midi.midiData[0] = (char)(0x90 | channel);
+                    midi.midiData[1] = (char)held[channel];
+                    midi.midiData[2] = (char)(1 + random() % 127);
+                }
+                block.events.events[i] = (VstEvent*)&midi;
+            }
+            std::sort(block.midi, block.midi + count, [](const VstMidiEvent& a, const VstMidiEvent& b) { return a.deltaFrames < b.deltaFrames; });
+            block.events.numEvents = count;
+        }
+    }
+
+    // Runs a batch of tasks on a fixed set of threads, the caller being one of
+    // them. Each thread takes tasks from the back of its own queue and, once
+    // that is empty, steals from the front of the others.
+    class WorkStealingPool
+    {
+    public:
+        typedef void (*Task)(size_t index, void* context);
+
+        WorkStealingPool(unsigned int threads)
+            : queues_(threads)
+            , task_(NULL)
+            , context_(NULL)
+            , pending_(0)
+            , generation_(0)
+            , stopping_(false)
+        {
+            for (unsigned int i = 1; i < threads; ++i)
+            {
+                workers_.push_back(std::thread(&WorkStealingPool::work, this, i));
+            }
+        }
+
+        ~WorkStealingPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(wakeup_mutex_);
+                stopping_ = true;
+            }
+            wakeup_.notify_all();
+            for (size_t i = 0; i < workers_.size(); ++i)
+            {
+                workers_[i].join();
+            }
+        }
+
+        // returns when task ran for every index below count
+        void run(size_t count, Task task, void* context)
+        {
+            task_ = task;
+            context_ = context;
+            pending_.store(count);
+            for (size_t i = 0; i < count; ++i)
+            {
+                Queue& queue = queues_[i % queues_.size()];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                queue.tasks.push_back(i);
+            }
+            {
+                std::lock_guard<std::mutex> lock(wakeup_mutex_);
+                ++generation_;
+            }
+            wakeup_.notify_all();
+
+            drain(0);
+            while (pending_.load() != 0)
+            {
+                std::this_thread::yield();
+            }
+        }
+
+    private:
+        struct Queue
+        {
+            std::mutex mutex;
+            std::deque<size_t> tasks;
+            char padding[kCacheLineSize];   // queues of different threads on different lines
+        };
+
+        bool take(unsigned int thread, size_t& index)
+        {
+            for (size_t i = 0; i < queues_.size(); ++i)
+            {
+                Queue& queue = queues_[(thread + i) % queues_.size()];
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                if (!queue.tasks.empty())
+                {
+                    if (i == 0)
+                    {
+                        index = queue.tasks.back();
+                        queue.tasks.pop_back();
+                    }
+                    else
+                    {
+                        index = queue.tasks.front();
+                        queue.tasks.pop_front();
+                    }
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void drain(unsigned int thread)
+        {
+            size_t index;
+            while (take(thread, index))
+            {
+                task_(index, context_);
+                pending_.fetch_sub(1);
+            }
+        }
+
+        void work(unsigned int thread)
+        {
+            unsigned long long generation = 0;
+            for (;;)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(wakeup_mutex_);
+                    wakeup_.wait(lock, [&]() { return stopping_ || generation_ != generation; });
+                    if (stopping_)
+                    {
+                        return;
+                    }
+                    generation = generation_;
+                }
+                drain(thread);
+            }
+        }
+
+        std::vector<Queue> queues_;
+        std::vector<std::thread> workers_;
+        Task task_;
+        void* context_;
+        std::atomic<size_t> pending_;
+        std::mutex wakeup_mutex_;
+        std::condition_variable wakeup_;
+        unsigned long long generation_;
+        bool stopping_;
+    };
+
+    // an instance with its own output buffers, as hosts give every plugin
+    struct BenchInstance
+    {
+        Ntpcs* plugin;
+        std::vector<float> out1;
+        std::vector<float> out2;
+        float* outputs[2];
+    };
+
+    struct ScaleContext
+    {
+        std::vector<BenchInstance>* instances;
+        BenchBlock* block;
+    };
+
+    void processInstance(size_t index, void* context)
+    {
+        ScaleContext& scale = *(ScaleContext*)context;
+        BenchInstance& instance = (*scale.instances)[index];
+        instance.plugin->processEvents((VstEvents*)&scale.block->events);
+        instance.plugin->processReplacing(NULL, instance.outputs, kBenchBlockSize);
+    }
+
+    double percentile(std::vector<double>& values, double fraction)
+    {
+        size_t index = (size_t)(fraction * (values.size() - 1));
+        std::nth_element(values.begin(), values.begin() + index, values.end());
+        return values[index];
+    }
+
+    int scale(size_t instances, size_t block_count, unsigned int cores)
+    {
+        std::vector<BenchBlock> blocks(block_count);
+        makeBlocks(blocks);
+
+        std::vector<BenchInstance> plugins(instances);
+        for (size_t i = 0; i < instances; ++i)
+        {
+            BenchInstance& instance = plugins[i];
+            instance.out1.resize(kBenchBlockSize);
+            instance.out2.resize(kBenchBlockSize);
+            instance.outputs[0] = &instance.out1[0];
+            instance.outputs[1] = &instance.out2[0];
+            instance.plugin = new Ntpcs(hostCallback);
+            instance.plugin->setSampleRate(kBenchSampleRate);
+            instance.plugin->setBlockSize(kBenchBlockSize);
+            instance.plugin->resume();
+        }
+
+        double budget_us = kBenchBlockSize / kBenchSampleRate * 1e6;
+        printf("%u instances, %u blocks of %d frames (%.0f us), up to %u threads\n",
+            (unsigned)instances, (unsigned)block_count, kBenchBlockSize, budget_us, cores);
+        printf("threads  p50 us   p99 us   max us   speedup  efficiency\n");
+
+        double single_thread_seconds = 0;
+        for (unsigned int threads = 1; ; threads = (std::min)(threads * 2, cores))
+        {
+            WorkStealingPool pool(threads);
+            ScaleContext context;
+            context.instances = &plugins;
+
+            memset(&g_time_info, 0, sizeof(g_time_info));
+            g_time_info.sampleRate = kBenchSampleRate;
+            g_time_info.tempo = 120;
+            g_time_info.flags = kVstTransportPlaying | kVstPpqPosValid | kVstTempoValid;
+
+            std::vector<double> block_us(block_count);
+            std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+            for (size_t b = 0; b < block_count; ++b)
+            {
+                context.block = &blocks[b];
+                std::chrono::steady_clock::time_point block_begin = std::chrono::steady_clock::now();
+                pool.run(instances, processInstance, &context);
+                block_us[b] = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - block_begin).count();
+
+                g_time_info.samplePos += kBenchBlockSize;
+                g_time_info.ppqPos += kBenchBlockSize / kBenchSampleRate * g_time_info.tempo / 60.0;
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            if (threads == 1)
+            {
+                single_thread_seconds = seconds;
+            }
+
+            double speedup = single_thread_seconds / seconds;
+            double p50 = percentile(block_us, 0.5);
+            double p99 = percentile(block_us, 0.99);
+            double max = *std::max_element(block_us.begin(), block_us.end());
+            printf("%7u %8.1f %8.1f %8.1f %9.2f %10.0f%%%s\n",
+                threads, p50, p99, max, speedup, 100.0 * speedup / threads, p99 > budget_us ? "  over budget" : "");
+
+            if (threads == cores)
+            {
+                break;
+            }
+        }
+
+        for (size_t i = 0; i < instances; ++i)
+        {
+            plugins[i].plugin->suspend();
+            delete plugins[i].plugin;
+        }
+        return 0;
+    }
+
+    double elapsedMicroseconds(std::chrono::steady_clock::time_point begin)
+    {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - begin).count();
+    }
+
+    void printStep(const char* name, double us, size_t instances)
+    {
+        printf("%-10s %10.1f ms %8.1f us/instance\n", name, us / 1000, us / instances);
+    }
+
+    int open(size_t instances)
+    {
+        std::vector<Ntpcs*> plugins(instances);
+        printf("%u instances\n", (unsigned)instances);
+
+        // a scan constructs and deletes without ever resuming
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < instances; ++i)
+        {
+            delete new Ntpcs(hostCallback);
+        }
+        printStep("scan", elapsedMicroseconds(begin), instances);
+
+        begin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < instances; ++i)
+        {
+            plugins[i] = new Ntpcs(hostCallback);
+        }
+        printStep("construct", elapsedMicroseconds(begin), instances);
+
+        begin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < instances; ++i)
+        {
+            plugins[i]->setSampleRate(kBenchSampleRate);
+            plugins[i]->setBlockSize(kBenchBlockSize);
+            plugins[i]->resume();
+        }
+        printStep("resume", elapsedMicroseconds(begin), instances);
+
+        begin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < instances; ++i)
+        {
+            plugins[i]->suspend();
+        }
+        printStep("suspend", elapsedMicroseconds(begin), instances);
+
+        begin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < instances; ++i)
+        {
+            delete plugins[i];
+        }
+        printStep("delete", elapsedMicroseconds(begin), instances);
+        return 0;
+    }
+
+    // splits of the keyboard and velocity, as a project with layered zones has
+    void makeState(size_t rules, std::vector<unsigned char>& chunk)
+    {
+        NtpcsState state;
+        state.midi_thru = true;
+        state.clock_port = kPortA;
+        state.sysex_port = kPortB;
+        state.thru_port = kPortB;
+        for (int ch = 0; ch < 16; ++ch)
+        {
+            state.program_change_port[ch] = ch % 2 ? kPortA : kPortB;
+            state.program_change_interval[ch] = 20.0;
+        }
+        state.clock_outputs = kClockOutputMidiClock;
+        for (size_t i = 0; i < rules; ++i)
+        {
+            ZoneRule rule;
+            rule.channel = (int)(i % 17) - 1;
+            rule.key_low = (int)(i * 12 % 128);
+            rule.key_high = (std::min)(rule.key_low + 11, 127);
+            rule.velocity_low = i % 2 ? 64 : 0;
+            rule.velocity_high = i % 2 ? 127 : 63;
+            rule.program = (int)(i % 128);
+            rule.bank = i % 3 ? (int)i : -1;
+            rule.output_channel = (int)(i % 16);
+            state.zone_rules.push_back(rule);
+        }
+        writeState(state, chunk);
+    }
+
+    int load(size_t instances, size_t rules)
+    {
+        std::vector<unsigned char> chunk;
+        makeState(rules, chunk);
+        printf("%u instances, %u zone rules, %u bytes of state\n", (unsigned)instances, (unsigned)rules, (unsigned)chunk.size());
+
+        std::vector<Ntpcs*> plugins(instances);
+        for (size_t i = 0; i < instances; ++i)
+        {
+            plugins[i] = new Ntpcs(hostCallback);
+            plugins[i]->setSampleRate(kBenchSampleRate);
+            plugins[i]->setBlockSize(kBenchBlockSize);
+        }
+
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < instances; ++i)
+        {
+            if (plugins[i]->setChunk(&chunk[0], (VstInt32)chunk.size(), false) == 0)
+            {
+                fprintf(stderr, "instance %u rejected the state\n", (unsigned)i);
+                return 1;
+            }
+        }
+        printStep("setChunk", elapsedMicroseconds(begin), instances);
+
+        begin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < instances; ++i)
+        {
+            plugins[i]->resume();
+        }
+        printStep("resume", elapsedMicroseconds(begin), instances);
+
+        // the restored state must save as it was loaded
+        void* data = NULL;
+        VstInt32 size = plugins[instances - 1]->getChunk(&data, false);
+        bool same = size == (VstInt32)chunk.size() && memcmp(data, &chunk[0], size) == 0;
+
+        for (size_t i = 0; i < instances; ++i)
+        {
+            plugins[i]->suspend();
+            delete plugins[i];
+        }
+        if (!same)
+        {
+            fprintf(stderr, "getChunk differs from the loaded state\n");
+            return 1;
+        }
+        return 0;
+    }
+
+    void usage()
+    {
+        fprintf(stderr, "usage: hostbench scale [instances] [blocks] [threads]\n"
+            "       hostbench open [instances]\n"
+            "       hostbench load [instances] [rules]\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        usage();
+        return 2;
+    }
+
+    if (strcmp(argv[1], "scale") == 0)
+    {
+        size_t instances = argc > 2 ? strtoul(argv[2], NULL, 10) : kBenchInstances;
+        size_t blocks = argc > 3 ? strtoul(argv[3], NULL, 10) : kBenchBlocks;
+        unsigned int threads = argc > 4 ? strtoul(argv[4], NULL, 10) : (std::max)(std::thread::hardware_concurrency(), 1u);
+        if (instances == 0 || blocks == 0 || threads == 0)
+        {
+            usage();
+            return 2;
+        }
+        return scale(instances, blocks, threads);
+    }
+    if (strcmp(argv[1], "open") == 0)
+    {
+        size_t instances = argc > 2 ? strtoul(argv[2], NULL, 10) : kBenchOpenInstances;
+        if (instances == 0)
+        {
+            usage();
+            return 2;
+        }
+        return open(instances);
+    }
+    if (strcmp(argv[1], "load") == 0)
+    {
+        size_t instances = argc > 2 ? strtoul(argv[2], NULL, 10) : kBenchOpenInstances;
+        size_t rules = argc > 3 ? strtoul(argv[3], NULL, 10) : kBenchLoadRules;
+        if (instances == 0 || rules > kStateMaxRules)
+        {
+            usage();
+            return 2;
+        }
+        return load(instances, rules);
+    }
+
+    usage();
+    return 2;
+}
@@ -0,0 +1,188 @@
+// logbench: compare the log formatters on records per second and heap
+// allocations per record.
+//
+//   logbench [records]
+//
+// stream:  the formatter NtpcsLogFormatter replaced, an nstringstream with
+//          setw/setfill and localtime_s per record
+// string:  NtpcsLogFormatter::format(record), returning a string
+// buffer:  NtpcsLogFormatter::format(record, buf, size), as BufferedFileAppender
+//          calls it
+//
+// Records are formatted as the writer thread sees them, as snapshots taken by
+// AsyncAppender.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <new>
+#include <vector>
+#include "logger.h"
+
+#define kBenchRecords 1000000       // default number of records formatted per formatter
+#define kBenchDistinctRecords 1024  // records cycled through, a millisecond apart
+
+static unsigned long long g_allocations = 0;
+
+void* operator new(size_t size)
+{
+    ++g_allocations;
+    void* p = malloc(size ? size : 1);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void* operator new[](size_t size)
+{
+    ++g_allocations;
+    void* p = malloc(size ? size : 1);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    free(p);
+}
+
+namespace
+{
+    // the formatter before the compile-time pattern, kept for comparison
+    struct StreamFormatter
+    {
+        static plog::util::nstring format(const plog::Record& record)
+        {
+            tm t;
+            plog::util::localtime_s(&t, &record.getTime().time);
+
+            plog::util::nstringstream ss;
+            ss << t.tm_year + 1900 << "-"
+                << std::setfill(PLOG_NSTR('0')) << std::setw(2) << t.tm_mon + 1 << PLOG_NSTR("-")
+                << std::setfill(PLOG_NSTR('0')) << std::setw(2) << t.tm_mday << PLOG_NSTR(" ");
+            ss << std::setfill(PLOG_NSTR('0')) << std::setw(2) << t.tm_hour << PLOG_NSTR(":")
+                << std::setfill(PLOG_NSTR('0')) << std::setw(2) << t.tm_min << PLOG_NSTR(":")
+                << std::setfill(PLOG_NSTR('0')) << std::setw(2) << t.tm_sec << PLOG_NSTR(".")
+                << std::setfill(PLOG_NSTR('0')) << std::setw(3) << record.getTime().millitm << PLOG_NSTR(" ");
+            ss << std::setfill(PLOG_NSTR(' ')) << std::setw(5) << std::left << plog::severityToString(record.getSeverity()) << PLOG_NSTR(" ");
+            ss << PLOG_NSTR("[") << record.getFunc() << PLOG_NSTR("] ");
+            ss << record.getMessage() << PLOG_NSTR("\n");
+
+            return ss.str();
+        }
+    };
+
+    // record with a chosen time, so the benchmark crosses seconds like a real log
+    class BenchRecord : public plog::Record
+    {
+    public:
+        BenchRecord(const plog::util::Time& time)
+            : plog::Record(plog::debug, "Ntpcs::processReplacing", __LINE__, "", NULL)
+            , m_time(time)
+        {
+        }
+
+        virtual const plog::util::Time& getTime() const { return m_time; }
+
+    private:
+        plog::util::Time m_time;
+    };
+
+    struct Result
+    {
+        double records_per_second;
+        double allocations_per_record;
+        size_t checksum;    // keeps the formatted output alive
+    };
+
+    template<class Format>
+    Result run(const std::vector<plog::RecordSnapshot>& records, unsigned long long count, Format format)
+    {
+        size_t checksum = 0;
+        unsigned long long allocations = g_allocations;
+        std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+        for (unsigned long long i = 0; i < count; ++i)
+        {
+            checksum += format(records[i % records.size()]);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        Result result;
+        result.records_per_second = count / seconds;
+        result.allocations_per_record = double(g_allocations - allocations) / count;
+        result.checksum = checksum;
+        return result;
+    }
+
+    void print(const char* name, const Result& result)
+    {
+        printf("%-8s %12.0f records/s %8.2f allocations/record\n", name, result.records_per_second, result.allocations_per_record);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    unsigned long long count = argc > 1 ? strtoull(argv[1], NULL, 10) : kBenchRecords;
+    if (count == 0)
+    {
+        fprintf(stderr, "usage: logbench [records]\n");
+        return 2;
+    }
+
+    plog::util::Time time;
+    plog::util::ftime(&time);
+    std::vector<plog::RecordSnapshot> records(kBenchDistinctRecords);
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        BenchRecord record(time);
+        record << "<< SEND MIDI EVENT: CLOCK >> port: 1 deltaFrames: " << i % 512;
+        records[i].assign(record);
+
+        if (++time.millitm == 1000)
+        {
+            time.millitm = 0;
+            ++time.time;
+        }
+    }
+
+    // the layouts must match, or the comparison is meaningless
+    plog::util::nchar buf[kMaxRecordLength];
+    for (size_t i = 0; i < records.size(); ++i)
+    {
+        plog::util::nstring expected = StreamFormatter::format(records[i]);
+        size_t length = plog::NtpcsLogFormatter::format(records[i], buf, kMaxRecordLength);
+        if (expected != plog::util::nstring(buf, length))
+        {
+            fprintf(stderr, "formatters differ on record %u\n", (unsigned)i);
+            return 1;
+        }
+    }
+
+    printf("%llu records\n", count);
+    print("stream", run(records, count, [](const plog::Record& record) { return StreamFormatter::format(record).size(); }));
+    print("string", run(records, count, [](const plog::Record& record) { return plog::NtpcsLogFormatter::format(record).size(); }));
+    print("buffer", run(records, count, [&buf](const plog::Record& record) { return plog::NtpcsLogFormatter::format(record, buf, kMaxRecordLength); }));
+    return 0;
+}
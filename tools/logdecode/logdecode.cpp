@@ -0,0 +1,171 @@
+// logdecode: convert binary debug logs written by BinaryFileAppender back to
+// the text layout of NtpcsLogFormatter.
+//
+//   logdecode ntpcs.debug.2.nlog ntpcs.debug.1.nlog ntpcs.debug.nlog > ntpcs.debug.log
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+#include <plog/Severity.h>
+#include "binarylog.h"
+
+struct CallSite
+{
+    int severity;
+    std::string func;
+    std::string tmpl;
+};
+
+static bool readFile(const char* file_name, std::vector<unsigned char>& data)
+{
+    FILE* file = fopen(file_name, "rb");
+    if (!file)
+        return false;
+
+    unsigned char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0)
+    {
+        data.insert(data.end(), buf, buf + n);
+    }
+    fclose(file);
+    return true;
+}
+
+static void writeTime(long long time_ms, std::string& out)
+{
+    time_t time = (time_t)(time_ms / 1000);
+    tm t;
+#ifdef _WIN32
+    localtime_s(&t, &time);
+#else
+    localtime_r(&time, &t);
+#endif
+    char text[64];
+    sprintf(text, "%04d-%02d-%02d %02d:%02d:%02d.%03d ",
+        t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec, (int)(time_ms % 1000));
+    out += text;
+}
+
+static bool decodeFile(const char* file_name)
+{
+    std::vector<unsigned char> data;
+    if (!readFile(file_name, data))
+    {
+        fprintf(stderr, "%s: cannot open\n", file_name);
+        return false;
+    }
+
+    const unsigned char* pos = data.empty() ? NULL : &data[0];
+    const unsigned char* end = pos + data.size();
+    if (data.size() < kBinaryLogMagicLength + 1 || memcmp(pos, kBinaryLogMagic, kBinaryLogMagicLength) != 0)
+    {
+        fprintf(stderr, "%s: not a binary log\n", file_name);
+        return false;
+    }
+    pos += kBinaryLogMagicLength;
+    if (*pos++ != kBinaryLogVersion)
+    {
+        fprintf(stderr, "%s: unsupported version %d\n", file_name, int(pos[-1]));
+        return false;
+    }
+
+    std::vector<CallSite> call_sites;
+    long long time = 0;
+    std::string line;
+    while (pos < end)
+    {
+        unsigned char tag = *pos++;
+        bool ok = false;
+        if (tag == binlog::kTagCallSite)
+        {
+            unsigned long long id, line_number;
+            CallSite site;
+            ok = binlog::getVarint(pos, end, id) && pos < end;
+            if (ok)
+            {
+                site.severity = *pos++;
+                ok = binlog::getString(pos, end, site.func)
+                    && binlog::getVarint(pos, end, line_number)
+                    && binlog::getString(pos, end, site.tmpl);
+            }
+            if (ok && id == 0)
+            {
+                // writer started a new table
+                call_sites.clear();
+                time = 0;
+            }
+            ok = ok && id == call_sites.size();
+            if (ok)
+                call_sites.push_back(site);
+        }
+        else if (tag == binlog::kTagRecord)
+        {
+            long long delta;
+            unsigned long long id;
+            ok = binlog::getZigzag(pos, end, delta) && binlog::getVarint(pos, end, id) && id < call_sites.size();
+            if (ok)
+            {
+                const CallSite& site = call_sites[(size_t)id];
+                time += delta;
+
+                line.clear();
+                writeTime(time, line);
+                const char* severity = plog::severityToString((plog::Severity)site.severity);
+                line += severity;
+                line.append(5 - std::min<size_t>(5, strlen(severity)), ' ');
+                line += " [";
+                line += site.func;
+                line += "] ";
+                for (size_t i = 0; ok && i < site.tmpl.size(); ++i)
+                {
+                    if (site.tmpl[i] == binlog::kArgMarker)
+                        ok = binlog::renderArg(pos, end, line);
+                    else
+                        line += site.tmpl[i];
+                }
+                line += '\n';
+                if (ok)
+                    fwrite(line.data(), 1, line.size(), stdout);
+            }
+        }
+
+        if (!ok)
+        {
+            // a file cut off by a crash ends with a partial record
+            fprintf(stderr, "%s: corrupt record at offset %lu\n", file_name, (unsigned long)(pos - &data[0]));
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: logdecode <file>...\n");
+        return 2;
+    }
+
+#ifdef _WIN32
+    // keep '\n' line endings like the text log
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+    int result = 0;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (!decodeFile(argv[i]))
+            result = 1;
+    }
+    return result;
+}
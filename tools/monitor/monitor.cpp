@@ -0,0 +1,110 @@
+// monitor: list the plugin instances publishing telemetry (NTPCS_TELEMETRY=1)
+// and refresh their stats 10 times a second until interrupted.
+//
+//   monitor [-1]
+//
+//   -1  print the list once and exit
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include "telemetry.h"
+
+#define kMonitorInterval 100    // milliseconds between refreshes
+
+struct SlotHistory
+{
+    unsigned int process_id;
+    unsigned int instance_id;
+    unsigned long long blocks;
+    unsigned long long input_events;
+};
+
+static void printStats(const TelemetrySegment* segment, SlotHistory* history, double seconds)
+{
+    printf("%4s %8s %4s %12s %9s %5s %8s %10s %8s %8s %s\n",
+        "slot", "pid", "inst", "blocks", "events/s", "held", "tempo", "clocks", "programs", "dropped", "state");
+
+    unsigned int instances = 0;
+    for (unsigned int i = 0; i < kTelemetrySlots; ++i)
+    {
+        TelemetryStats stats;
+        if (!readTelemetrySlot(segment->slots[i], stats))
+        {
+            history[i].instance_id = 0;
+            continue;
+        }
+        ++instances;
+
+        // rates need the previous refresh of the same instance
+        SlotHistory& previous = history[i];
+        bool known = previous.instance_id == stats.instance_id && previous.process_id == stats.process_id && seconds > 0;
+        double events_per_second = known ? (stats.input_events - previous.input_events) / seconds : 0;
+        const char* state = !known ? "new" : stats.blocks == previous.blocks ? "idle" : "running";
+
+        printf("%4u %8u %4u %12llu %9.0f %5u %8.2f %10llu %8llu %8llu %s\n",
+            i, stats.process_id, stats.instance_id, stats.blocks, events_per_second,
+            stats.held_notes, stats.tempo, stats.clocks_sent, stats.program_changes_sent,
+            stats.dropped_events, state);
+
+        previous.process_id = stats.process_id;
+        previous.instance_id = stats.instance_id;
+        previous.blocks = stats.blocks;
+        previous.input_events = stats.input_events;
+    }
+    if (instances == 0)
+        printf("no instances\n");
+}
+
+int main(int argc, char* argv[])
+{
+    bool once = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-1") == 0)
+        {
+            once = true;
+        }
+        else
+        {
+            fprintf(stderr, "usage: monitor [-1]\n");
+            return 2;
+        }
+    }
+
+    TelemetryMapping mapping;
+    if (!mapping.open(false))
+    {
+        fprintf(stderr, "no telemetry segment %s, is a plugin running with NTPCS_TELEMETRY=1?\n", kTelemetrySegmentName);
+        return 1;
+    }
+
+#ifdef _WIN32
+    // let the console handle the escape sequences that clear it
+    HANDLE console = GetStdHandle(STD_OUTPUT_HANDLE);
+    DWORD mode = 0;
+    if (GetConsoleMode(console, &mode))
+        SetConsoleMode(console, mode | 0x0004);     // ENABLE_VIRTUAL_TERMINAL_PROCESSING
+#endif
+
+    SlotHistory history[kTelemetrySlots];
+    memset(history, 0, sizeof(history));
+    std::chrono::steady_clock::time_point last = std::chrono::steady_clock::now();
+    printStats(mapping.getSegment(), history, 0);
+    while (!once)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(kMonitorInterval));
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(now - last).count();
+        last = now;
+
+        printf("\033[H\033[2J");    // home and clear
+        printStats(mapping.getSegment(), history, seconds);
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,231 @@
+// replay: run the plugin on a session recorded with NTPCS_CAPTURE as fast as the
+// CPU allows. Every output event is printed with its block, so the output of two
+// builds can be diffed. A summary goes to stderr.
+//
+//   replay [-q] [-rt] [-log categories] session.ncap > events.txt
+//
+//   -q   do not print output events (profiling)
+//   -rt  check that processEvents and processReplacing do not allocate, lock a
+//        mutex or do file I/O, list each violation with its call stack and fail
+//   -log enable debug log categories as NTPCS_LOG does, the log goes to the
+//        current directory. Run -rt -log all on release builds before a change
+//        to logging is merged, records must not allocate on the audio thread.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "capture.h"
+#include "ntpcs.h"
+#include "rtcheck.h"
+
+static const VstTimeInfo* g_time_info = NULL;   // time info of the block being processed
+static unsigned long long g_block = 0;
+static unsigned long long g_output_events = 0;
+static bool g_quiet = false;
+
+static void printEvent(const VstEvent* ev)
+{
+    if (ev->type == kVstMidiType)
+    {
+        const VstMidiEvent* midi = (const VstMidiEvent*)ev;
+        printf("%llu %d %02X %02X %02X\n", g_block, int(midi->deltaFrames),
+            (unsigned char)midi->midiData[0], (unsigned char)midi->midiData[1], (unsigned char)midi->midiData[2]);
+    }
+    else if (ev->type == kVstSysExType)
+    {
+        const VstMidiSysexEvent* sysex = (const VstMidiSysexEvent*)ev;
+        printf("%llu %d", g_block, int(sysex->deltaFrames));
+        for (VstInt32 i = 0; i < sysex->dumpBytes; ++i)
+        {
+            printf(" %02X", (unsigned char)sysex->sysexDump[i]);
+        }
+        printf("\n");
+    }
+}
+
+static VstIntPtr VSTCALLBACK hostCallback(AEffect* effect, VstInt32 opcode, VstInt32 index, VstIntPtr value, void* ptr, float opt)
+{
+    rtcheck::HostScope host_scope;
+    switch (opcode)
+    {
+    case audioMasterVersion:
+        return kVstVersion;
+    case audioMasterGetTime:
+        return (VstIntPtr)g_time_info;
+    case audioMasterProcessEvents:
+        {
+            VstEvents* events = (VstEvents*)ptr;
+            g_output_events += events->numEvents;
+            for (VstInt32 i = 0; i < events->numEvents && !g_quiet; ++i)
+            {
+                printEvent(events->events[i]);
+            }
+        }
+        return 1;
+    }
+    return 0;
+}
+
+static void unsetCaptureEnvironment()
+{
+    // the replayed plugin must not capture itself
+#ifdef _WIN32
+    _putenv("NTPCS_CAPTURE=");
+#else
+    unsetenv("NTPCS_CAPTURE");
+#endif
+}
+
+static void setLogEnvironment(const char* categories)
+{
+#ifdef _WIN32
+    _putenv_s("NTPCS_LOG", categories);
+#else
+    setenv("NTPCS_LOG", categories, 1);
+#endif
+}
+
+int main(int argc, char* argv[])
+{
+    const char* file_name = NULL;
+    const char* log_categories = NULL;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-q") == 0)
+            g_quiet = true;
+        else if (strcmp(argv[i], "-rt") == 0)
+            rtcheck::enable();
+        else if (strcmp(argv[i], "-log") == 0 && i + 1 < argc)
+            log_categories = argv[++i];
+        else
+            file_name = argv[i];
+    }
+
+    if (!file_name)
+    {
+        fprintf(stderr, "usage: replay [-q] [-rt] [-log categories] session.ncap\n");
+        return 2;
+    }
+
+    CaptureReader reader;
+    if (!reader.open(file_name))
+    {
+        fprintf(stderr, "%s: not a capture file\n", file_name);
+        return 1;
+    }
+
+    unsetCaptureEnvironment();
+    if (log_categories)
+        setLogEnvironment(log_categories);
+    Ntpcs* plugin = new Ntpcs(hostCallback);
+
+    std::vector<float> out1;
+    std::vector<float> out2;
+    float* outputs[2];
+    float sample_rate = 0;
+    VstInt32 block_size = 0;
+    bool resumed = false;
+    unsigned long long input_events = 0;
+    unsigned long long gaps = 0;
+    double audio_seconds = 0;
+
+    // like a host, resume with the largest block size before the first input arrives
+    CaptureReader scan;
+    scan.open(file_name);
+    for (int tag = scan.next(); tag != 0; tag = scan.next())
+    {
+        if (tag == kCaptureBlock)
+        {
+            if (sample_rate == 0)
+                sample_rate = scan.getSampleRate();
+            block_size = (std::max)(scan.getSampleFrames(), block_size);
+        }
+    }
+    if (sample_rate > 0)
+    {
+        plugin->setSampleRate(sample_rate);
+        plugin->setBlockSize(block_size);
+        plugin->resume();
+        resumed = true;
+
+        out1.resize(block_size);
+        out2.resize(block_size);
+        outputs[0] = &out1[0];
+        outputs[1] = &out2[0];
+    }
+
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    for (int tag = reader.next(); tag != 0; tag = reader.next())
+    {
+        if (tag == kCaptureEvents)
+        {
+            VstEvents* events = reader.getEvents();
+            input_events += events->numEvents;
+            rtcheck::AudioScope audio_scope;
+            plugin->processEvents(events);
+        }
+        else if (tag == kCaptureBlock)
+        {
+            VstInt32 sample_frames = reader.getSampleFrames();
+
+            // a host changes the sample rate and block size only while suspended
+            if (reader.getSampleRate() != sample_rate || sample_frames > block_size)
+            {
+                if (resumed)
+                    plugin->suspend();
+                sample_rate = reader.getSampleRate();
+                block_size = (std::max)(sample_frames, block_size);
+                plugin->setSampleRate(sample_rate);
+                plugin->setBlockSize(block_size);
+                plugin->resume();
+                resumed = true;
+
+                out1.resize(block_size);
+                out2.resize(block_size);
+                outputs[0] = &out1[0];
+                outputs[1] = &out2[0];
+            }
+
+            g_time_info = reader.getTimeInfo();
+            {
+                rtcheck::AudioScope audio_scope;
+                plugin->processReplacing(NULL, outputs, sample_frames);
+            }
+            if (sample_rate > 0)
+                audio_seconds += sample_frames / sample_rate;
+            ++g_block;
+        }
+        else if (tag == kCaptureGap)
+        {
+            gaps += reader.getGap();
+            if (!g_quiet)
+                printf("%llu gap %u\n", g_block, reader.getGap());
+        }
+    }
+    double wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    if (resumed)
+        plugin->suspend();
+    delete plugin;
+
+    fprintf(stderr, "blocks: %llu, input events: %llu, output events: %llu, dropped records: %llu\n",
+        g_block, input_events, g_output_events, gaps);
+    fprintf(stderr, "audio: %.3f s, replay: %.3f s (%.1fx real time)\n",
+        audio_seconds, wall_seconds, wall_seconds > 0 ? audio_seconds / wall_seconds : 0.0);
+
+    if (!reader.isValid())
+    {
+        fprintf(stderr, "%s: truncated or corrupt record after block %llu\n", file_name, g_block);
+        return 1;
+    }
+    if (rtcheck::isEnabled())
+    {
+        rtcheck::printReport(stderr);
+        if (rtcheck::getViolationCount() > 0)
+            return 1;
+    }
+    return 0;
+}
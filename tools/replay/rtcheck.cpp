@@ -0,0 +1,342 @@
+#include "rtcheck.h"
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <crtdbg.h>
+#else
+#include <execinfo.h>
+#include <unistd.h>
+#endif
+
+#if defined(__GLIBC__)
+#include <dlfcn.h>
+#include <pthread.h>
+#include <time.h>
+#define kRtCheckLibc 1
+#else
+#define kRtCheckLibc 0
+#endif
+
+#define kRtStackDepth 24        // frames recorded per violation
+#define kRtMaxViolations 64     // distinct violations kept, later ones are only counted
+
+namespace
+{
+    struct Violation
+    {
+        const char* what;
+        void* frames[kRtStackDepth];
+        int depth;
+        unsigned int count;
+    };
+
+    // plain integers, usable before any constructor ran and from inside malloc
+    thread_local int t_depth = 0;       // open AudioScopes
+    thread_local int t_reporting = 0;   // inside the checker itself, calls are not checked
+
+    std::atomic<bool> g_enabled(false);
+    std::mutex g_mutex;
+    Violation g_violations[kRtMaxViolations];
+    int g_violation_count = 0;
+    unsigned int g_total = 0;
+
+    int captureStack(void** frames)
+    {
+#ifdef _WIN32
+        return CaptureStackBackTrace(2, kRtStackDepth, frames, NULL);
+#else
+        return backtrace(frames, kRtStackDepth);
+#endif
+    }
+
+    void recordViolation(const char* what)
+    {
+        ++t_reporting;
+        void* frames[kRtStackDepth];
+        int depth = captureStack(frames);
+        {
+            std::lock_guard<std::mutex> lock(g_mutex);
+            ++g_total;
+
+            int i = 0;
+            for (; i < g_violation_count; ++i)
+            {
+                Violation& v = g_violations[i];
+                if (v.what == what && v.depth == depth && memcmp(v.frames, frames, depth * sizeof(void*)) == 0)
+                {
+                    ++v.count;
+                    break;
+                }
+            }
+            if (i == g_violation_count && g_violation_count < kRtMaxViolations)
+            {
+                Violation& v = g_violations[g_violation_count++];
+                v.what = what;
+                memcpy(v.frames, frames, depth * sizeof(void*));
+                v.depth = depth;
+                v.count = 1;
+            }
+        }
+        --t_reporting;
+    }
+
+    inline void check(const char* what)
+    {
+        if (t_depth > 0 && t_reporting == 0)
+        {
+            recordViolation(what);
+        }
+    }
+
+    void* allocate(const char* what, size_t size)
+    {
+        check(what);
+        ++t_reporting;     // the malloc below is part of this violation
+        void* p = malloc(size ? size : 1);
+        --t_reporting;
+        if (!p)
+        {
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+
+    void deallocate(const char* what, void* p)
+    {
+        if (!p)
+        {
+            return;
+        }
+        check(what);
+        ++t_reporting;
+        free(p);
+        --t_reporting;
+    }
+
+#if defined(_WIN32) && defined(_DEBUG)
+    int crtAllocHook(int alloc_type, void*, size_t, int block_type, long, const unsigned char*, int)
+    {
+        if (block_type != _CRT_BLOCK)
+        {
+            check(alloc_type == _HOOK_FREE ? "free" : alloc_type == _HOOK_REALLOC ? "realloc" : "malloc");
+        }
+        return TRUE;
+    }
+#endif
+}
+
+void* operator new(size_t size)
+{
+    return allocate("operator new", size);
+}
+
+void* operator new[](size_t size)
+{
+    return allocate("operator new[]", size);
+}
+
+void operator delete(void* p) noexcept
+{
+    deallocate("operator delete", p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    deallocate("operator delete[]", p);
+}
+
+// sized forms, C++14 compilers call these for complete types
+void operator delete(void* p, size_t) noexcept
+{
+    deallocate("operator delete", p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    deallocate("operator delete[]", p);
+}
+
+#if kRtCheckLibc
+// glibc: the executable's definitions take the place of the C library's for the
+// whole process, calls are forwarded to the originals
+extern "C"
+{
+    void* __libc_malloc(size_t);
+    void* __libc_calloc(size_t, size_t);
+    void* __libc_realloc(void*, size_t);
+    void __libc_free(void*);
+
+    void* malloc(size_t size) __THROW
+    {
+        check("malloc");
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size) __THROW
+    {
+        check("calloc");
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* p, size_t size) __THROW
+    {
+        check("realloc");
+        return __libc_realloc(p, size);
+    }
+
+    void free(void* p) __THROW
+    {
+        if (p)
+            check("free");
+        __libc_free(p);
+    }
+}
+
+// looked up on first use, dlsym may allocate but is never called from a checked scope first
+#define RTCHECK_FORWARD(name, type) \
+    static type next_##name = NULL; \
+    if (!next_##name) \
+    { \
+        ++t_reporting; \
+        next_##name = (type)dlsym(RTLD_NEXT, #name); \
+        --t_reporting; \
+    } \
+    check(#name)
+
+extern "C"
+{
+    int pthread_mutex_lock(pthread_mutex_t* mutex) __THROWNL
+    {
+        typedef int (*Function)(pthread_mutex_t*);
+        RTCHECK_FORWARD(pthread_mutex_lock, Function);
+        return next_pthread_mutex_lock(mutex);
+    }
+
+    ssize_t write(int fd, const void* data, size_t size)
+    {
+        typedef ssize_t (*Function)(int, const void*, size_t);
+        RTCHECK_FORWARD(write, Function);
+        return next_write(fd, data, size);
+    }
+
+    ssize_t read(int fd, void* data, size_t size)
+    {
+        typedef ssize_t (*Function)(int, void*, size_t);
+        RTCHECK_FORWARD(read, Function);
+        return next_read(fd, data, size);
+    }
+
+    FILE* fopen(const char* file_name, const char* mode)
+    {
+        typedef FILE* (*Function)(const char*, const char*);
+        RTCHECK_FORWARD(fopen, Function);
+        return next_fopen(file_name, mode);
+    }
+
+    size_t fwrite(const void* data, size_t size, size_t count, FILE* file)
+    {
+        typedef size_t (*Function)(const void*, size_t, size_t, FILE*);
+        RTCHECK_FORWARD(fwrite, Function);
+        return next_fwrite(data, size, count, file);
+    }
+
+    int fflush(FILE* file)
+    {
+        typedef int (*Function)(FILE*);
+        RTCHECK_FORWARD(fflush, Function);
+        return next_fflush(file);
+    }
+
+    int fclose(FILE* file)
+    {
+        typedef int (*Function)(FILE*);
+        RTCHECK_FORWARD(fclose, Function);
+        return next_fclose(file);
+    }
+
+    int nanosleep(const struct timespec* duration, struct timespec* remaining)
+    {
+        typedef int (*Function)(const struct timespec*, struct timespec*);
+        RTCHECK_FORWARD(nanosleep, Function);
+        return next_nanosleep(duration, remaining);
+    }
+}
+#endif
+
+namespace rtcheck
+{
+    void enable()
+    {
+        // the first backtrace loads the unwinder, do it outside any scope
+        void* frames[kRtStackDepth];
+        captureStack(frames);
+#if defined(_WIN32) && defined(_DEBUG)
+        _CrtSetAllocHook(crtAllocHook);
+#endif
+        g_enabled = true;
+    }
+
+    bool isEnabled()
+    {
+        return g_enabled;
+    }
+
+    AudioScope::AudioScope()
+        : entered_(g_enabled)
+    {
+        if (entered_)
+            ++t_depth;
+    }
+
+    AudioScope::~AudioScope()
+    {
+        if (entered_)
+            --t_depth;
+    }
+
+    HostScope::HostScope()
+        : saved_depth_(t_depth)
+    {
+        t_depth = 0;
+    }
+
+    HostScope::~HostScope()
+    {
+        t_depth = saved_depth_;
+    }
+
+    unsigned int getViolationCount()
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        return g_total;
+    }
+
+    void printReport(FILE* file)
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        fprintf(file, "real-time violations: %u\n", g_total);
+        for (int i = 0; i < g_violation_count; ++i)
+        {
+            const Violation& v = g_violations[i];
+            fprintf(file, "%s called %u times from:\n", v.what, v.count);
+            fflush(file);
+#ifdef _WIN32
+            for (int f = 0; f < v.depth; ++f)
+            {
+                fprintf(file, "    %p\n", v.frames[f]);
+            }
+#else
+            backtrace_symbols_fd(const_cast<void**>(v.frames), v.depth, fileno(file));
+#endif
+        }
+        if (g_total > 0 && g_violation_count == kRtMaxViolations)
+        {
+            fprintf(file, "(only the first %d distinct call stacks are listed)\n", kRtMaxViolations);
+        }
+    }
+}
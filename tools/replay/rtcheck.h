@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdio>
+
+// Real-time safety checker of the replay tool.
+//
+// The tool replaces operator new/delete and, with glibc, malloc, free, pthread
+// mutexes and file I/O entry points. Calls made while an AudioScope is open on
+// the calling thread are recorded with their call stack as violations. Windows
+// debug builds check the CRT heap only, through an allocation hook.
+namespace rtcheck
+{
+    // starts checking, before that the scopes do nothing
+    void enable();
+    bool isEnabled();
+
+    // brackets a call into an audio-thread entry point of the plugin
+    class AudioScope
+    {
+    public:
+        AudioScope();
+        ~AudioScope();
+
+    private:
+        bool entered_;
+    };
+
+    // brackets host code called back from the plugin, which is not checked
+    class HostScope
+    {
+    public:
+        HostScope();
+        ~HostScope();
+
+    private:
+        int saved_depth_;
+    };
+
+    unsigned int getViolationCount();
+
+    // prints each distinct violation with its call stack and count
+    void printReport(FILE*);
+}